@@ -0,0 +1,130 @@
+// Allocation benchmark: request parsing with and without the arena, and filling/churning the
+// store, which is where the linked malloc (KV_ALLOCATOR) makes a difference.
+//   bench_alloc [keys]
+#include "kv/kvstore.h"
+#include "net/resp.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    size_t allocations = 0;
+    volatile size_t sink = 0; // keeps the parsed results alive
+
+    double seconds_since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    size_t resident_mb() {
+        long pages = 0, resident = 0;
+        if (FILE* f = std::fopen("/proc/self/statm", "r")) {
+            if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+                resident = 0;
+            }
+            std::fclose(f);
+        }
+        return static_cast<size_t>(resident) * sysconf(_SC_PAGESIZE) / (1 << 20);
+    }
+
+    // A pipelined batch like the load test sends
+    std::vector<std::string> make_commands(size_t n) {
+        std::vector<std::string> lines;
+        for (size_t i = 0; i < n; i++) {
+            lines.push_back(i % 4 == 3 ? "ZADD leaderboard " + std::to_string(i % 1000) + " player" + std::to_string(i)
+                                       : "SET client" + std::to_string(i % 50) + "_key" + std::to_string(i) + " value" + std::to_string(i));
+        }
+        return lines;
+    }
+
+    template <typename Parse>
+    void bench_parse(const char* name, const std::vector<std::string>& lines, Parse parse) {
+        size_t before = allocations;
+        auto start = std::chrono::steady_clock::now();
+        for (int round = 0; round < 20; round++) {
+            for (const auto& line : lines) {
+                sink = sink + parse(line);
+            }
+        }
+        double elapsed = seconds_since(start);
+        size_t commands = lines.size() * 20;
+        std::printf("  %-28s %7.1f ns/command  %5.2f allocations/command\n", name,
+                    elapsed * 1e9 / commands, double(allocations - before) / commands);
+    }
+}
+
+// Counts every operator new so the parse results show allocations per command
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char** argv) {
+    size_t keys = argc > 1 ? std::stoull(argv[1]) : 200000;
+
+    std::cout << "Parsing " << 100000 << " pipelined commands x 20:\n";
+    auto lines = make_commands(100000);
+    bench_parse("istringstream + vector", lines, [](const std::string& line) {
+        std::istringstream iss(line);
+        std::string token;
+        std::vector<std::string> tokens;
+        while (iss >> token) {
+            tokens.push_back(token);
+        }
+        return tokens.size();
+    });
+
+    kv::Arena arena;
+    bench_parse("split_command into arena", lines, [&](const std::string& line) {
+        kv::ArenaScope scope(arena);
+        kv::ArenaVector<std::string> tokens(arena);
+        kv::split_command(line, tokens);
+        return tokens.size();
+    });
+
+    std::cout << "\nStore with " << keys << " string keys, " << keys / 10 << " sorted sets, " << keys / 10 << " hashes:\n";
+    kv::KVStore store;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < keys; i++) {
+        store.set("key" + std::to_string(i), std::string(16 + i % 64, 'v'));
+    }
+    for (size_t i = 0; i < keys / 10; i++) {
+        for (int m = 0; m < 20; m++) {
+            store.zadd("zset" + std::to_string(i), "member" + std::to_string(m), m * 1.5);
+        }
+        store.hset("hash" + std::to_string(i), {{"name", "value" + std::to_string(i)}, {"count", std::to_string(i)}});
+    }
+    std::printf("  fill   %6.2f s  rss %zu MB\n", seconds_since(start), resident_mb());
+
+    // Replace half the strings with different sizes and rebuild the sets, which fragments
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < 3; round++) {
+        for (size_t i = round % 2; i < keys; i += 2) {
+            store.set("key" + std::to_string(i), std::string(8 + (i * 7 + round * 13) % 120, 'w'));
+        }
+        for (size_t i = 0; i < keys / 10; i += 2) {
+            store.del("zset" + std::to_string(i));
+            for (int m = 0; m < 20 + round * 30; m++) {
+                store.zadd("zset" + std::to_string(i), "member" + std::to_string(m), m);
+            }
+        }
+    }
+    std::printf("  churn  %6.2f s  rss %zu MB\n", seconds_since(start), resident_mb());
+    return 0;
+}
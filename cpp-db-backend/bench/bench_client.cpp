@@ -0,0 +1,186 @@
+// End-to-end load test through the native client: throughput and latency percentiles against a
+// running tcp_server. Each thread keeps one batch of --batch requests in flight and waits for it;
+// requests from all threads share --connections pipelined sockets.
+//   bench_client [--host H] [--port N] [--unix PATH] [--connections N] [--threads N]
+//                [--requests N] [--batch N] [--keys N] [--value-size N] [--get-ratio R]
+#include "client/client.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        kv::ClientOptions client;
+        size_t threads = 4;
+        size_t requests = 200000; // in total
+        size_t batch = 16;
+        size_t keys = 10000;
+        size_t value_size = 32;
+        double get_ratio = 0.8;
+    };
+
+    bool parse_args(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) {
+                return false;
+            }
+            std::string value = argv[++i];
+            if (arg == "--host") {
+                options.client.host = value;
+            } else if (arg == "--port") {
+                options.client.port = std::stoi(value);
+            } else if (arg == "--unix") {
+                options.client.unix_path = value;
+            } else if (arg == "--connections") {
+                options.client.connections = std::stoull(value);
+            } else if (arg == "--threads") {
+                options.threads = std::max<size_t>(std::stoull(value), 1);
+            } else if (arg == "--requests") {
+                options.requests = std::stoull(value);
+            } else if (arg == "--batch") {
+                options.batch = std::max<size_t>(std::stoull(value), 1);
+            } else if (arg == "--keys") {
+                options.keys = std::max<size_t>(std::stoull(value), 1);
+            } else if (arg == "--value-size") {
+                options.value_size = std::max<size_t>(std::stoull(value), 1);
+            } else if (arg == "--get-ratio") {
+                options.get_ratio = std::stod(value);
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Counts a batch's replies down; the sending thread waits for zero
+    struct Latch {
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t remaining = 0;
+
+        void count_down() {
+            std::lock_guard lock(mutex);
+            if (--remaining == 0) {
+                cv.notify_one();
+            }
+        }
+
+        void wait() {
+            std::unique_lock lock(mutex);
+            cv.wait(lock, [this] { return remaining == 0; });
+        }
+    };
+
+    // Returns microseconds from submit to reply, one per request
+    std::vector<double> run_thread(kv::Client& client, const Options& options, size_t requests, unsigned seed,
+                                   std::atomic<size_t>& errors) {
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<size_t> pick_key(0, options.keys - 1);
+        std::bernoulli_distribution is_get(options.get_ratio);
+        std::string value(options.value_size, 'v');
+
+        std::vector<double> latencies(requests);
+        Latch latch;
+        for (size_t done = 0; done < requests;) {
+            size_t count = std::min(options.batch, requests - done);
+            latch.remaining = count;
+
+            kv::Batch batch;
+            auto start = Clock::now();
+            for (size_t i = 0; i < count; i++) {
+                std::string key = "key" + std::to_string(pick_key(rng));
+                std::vector<std::string> args = is_get(rng) ? std::vector<std::string>{"GET", key}
+                                                            : std::vector<std::string>{"SET", key, value};
+                double* latency = &latencies[done + i];
+                batch.add(args, [&latch, &errors, latency, start](kv::Reply reply) {
+                    *latency = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+                    if (reply.is_error()) {
+                        errors.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    latch.count_down();
+                });
+            }
+            client.execute(batch);
+            latch.wait();
+            done += count;
+        }
+        return latencies;
+    }
+
+    double percentile(const std::vector<double>& sorted, double p) {
+        size_t index = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_args(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [--host H] [--port N] [--unix PATH] [--connections N] [--threads N]"
+                  << " [--requests N] [--batch N] [--keys N] [--value-size N] [--get-ratio R]\n";
+        return 1;
+    }
+
+    try {
+        kv::Client client(options.client);
+
+        // Fill the keyspace so GETs hit
+        std::string value(options.value_size, 'v');
+        kv::Batch fill;
+        for (size_t i = 0; i < options.keys; i++) {
+            fill.add({"SET", "key" + std::to_string(i), value}, nullptr);
+            if (fill.size() == 1000 || i + 1 == options.keys) {
+                auto last = fill.add({"GET", "key0"});
+                client.execute(fill);
+                last.wait();
+            }
+        }
+
+        std::printf("%zu requests (%.0f%% GET, %zu-byte values) from %zu threads, batch %zu, %zu connections\n",
+                    options.requests, options.get_ratio * 100, options.value_size, options.threads, options.batch,
+                    options.client.connections);
+
+        std::atomic<size_t> errors{0};
+        std::vector<std::vector<double>> results(options.threads);
+        std::vector<std::thread> threads;
+        auto start = Clock::now();
+        for (size_t t = 0; t < options.threads; t++) {
+            size_t share = options.requests / options.threads + (t < options.requests % options.threads ? 1 : 0);
+            threads.emplace_back([&, t, share] { results[t] = run_thread(client, options, share, 1234 + t, errors); });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::vector<double> latencies;
+        for (auto& result : results) {
+            latencies.insert(latencies.end(), result.begin(), result.end());
+        }
+        if (latencies.empty()) {
+            return 0;
+        }
+        std::sort(latencies.begin(), latencies.end());
+
+        std::printf("  throughput  %10.0f requests/s  (%.2f s, %zu errors)\n", latencies.size() / elapsed, elapsed,
+                    errors.load());
+        std::printf("  latency us  p50 %.0f  p90 %.0f  p99 %.0f  p99.9 %.0f  max %.0f\n", percentile(latencies, 50),
+                    percentile(latencies, 90), percentile(latencies, 99), percentile(latencies, 99.9), latencies.back());
+    } catch (const std::exception& e) {
+        std::cerr << "bench_client: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,400 @@
+#include "client.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace kv
+{
+    namespace
+    {
+        int connect_tcp(const std::string &host, int port)
+        {
+            addrinfo hints;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+
+            addrinfo *res = nullptr;
+            if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0)
+            {
+                throw std::system_error(EHOSTUNREACH, std::generic_category(), "resolve " + host);
+            }
+
+            int sock = -1;
+            int error = ECONNREFUSED;
+            for (addrinfo *ai = res; ai != nullptr; ai = ai->ai_next)
+            {
+                sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+                if (sock < 0)
+                {
+                    error = errno;
+                    continue;
+                }
+                if (connect(sock, ai->ai_addr, ai->ai_addrlen) == 0)
+                {
+                    break;
+                }
+                error = errno;
+                close(sock);
+                sock = -1;
+            }
+            freeaddrinfo(res);
+
+            if (sock < 0)
+            {
+                throw std::system_error(error, std::generic_category(), "connect " + host + ":" + std::to_string(port));
+            }
+            int one = 1;
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // batches are already coalesced
+            return sock;
+        }
+
+        int connect_unix(const std::string &path)
+        {
+            sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(addr.sun_path))
+            {
+                throw std::system_error(ENAMETOOLONG, std::generic_category(), path);
+            }
+            memcpy(addr.sun_path, path.c_str(), path.size());
+
+            int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (sock < 0 || connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+            {
+                int error = errno;
+                if (sock >= 0)
+                {
+                    close(sock);
+                }
+                throw std::system_error(error, std::generic_category(), "connect " + path);
+            }
+            return sock;
+        }
+
+        bool send_all(int sock, const std::string &data)
+        {
+            size_t sent = 0;
+            while (sent < data.size())
+            {
+                ssize_t n = ::send(sock, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    return false;
+                }
+                sent += n;
+            }
+            return true;
+        }
+
+        // Commands that change what the connection's later replies mean
+        void check_command(const std::vector<std::string> &args, bool &in_multi, bool batched)
+        {
+            const std::string &name = args.empty() ? std::string() : args[0];
+            if (name == "SUBSCRIBE" || name == "PSUBSCRIBE" || name == "UNSUBSCRIBE" || name == "PUNSUBSCRIBE" || name == "PSYNC")
+            {
+                throw std::invalid_argument(name + " needs a dedicated connection");
+            }
+            if (name == "MULTI" || name == "EXEC" || name == "DISCARD")
+            {
+                if (!batched)
+                {
+                    throw std::invalid_argument(name + " is only allowed inside a batch");
+                }
+                if ((name == "MULTI") == in_multi)
+                {
+                    throw std::invalid_argument(in_multi ? "MULTI inside MULTI" : name + " without MULTI");
+                }
+                in_multi = name == "MULTI";
+            }
+        }
+
+        ReplyCallback fulfil(std::shared_ptr<std::promise<Reply>> promise)
+        {
+            return [promise](Reply reply) { promise->set_value(std::move(reply)); };
+        }
+    }
+
+    Connection::Connection(const ClientOptions &options)
+        : fd_(options.unix_path.empty() ? connect_tcp(options.host, options.port) : connect_unix(options.unix_path))
+    {
+    }
+
+    std::shared_ptr<Connection> Connection::open(const ClientOptions &options)
+    {
+        std::shared_ptr<Connection> connection(new Connection(options));
+        connection->reader_ = std::thread([self = connection] { self->read_loop(); });
+        return connection;
+    }
+
+    Connection::~Connection()
+    {
+        // Still joinable when the reader dropped the last reference, possibly on its own thread
+        if (reader_.joinable())
+        {
+            reader_.detach();
+        }
+        close(fd_);
+    }
+
+    void Connection::stop()
+    {
+        shutdown(fd_, SHUT_RDWR); // ends read_loop, which fails whatever is still waiting
+        if (reader_.joinable() && reader_.get_id() != std::this_thread::get_id())
+        {
+            reader_.join();
+        }
+    }
+
+    void Connection::submit(const std::string &lines, std::vector<ReplyCallback> callbacks)
+    {
+        bool queued = false;
+        {
+            std::lock_guard lock(mutex_);
+            if (!closed_.load(std::memory_order_relaxed))
+            {
+                outbox_ += lines;
+                outstanding_.fetch_add(callbacks.size(), std::memory_order_relaxed);
+                for (auto &callback : callbacks)
+                {
+                    waiting_.push_back(std::move(callback));
+                }
+                if (writing_)
+                {
+                    return; // the caller in flush() picks these up with its next write
+                }
+                writing_ = true;
+                queued = true;
+            }
+        }
+
+        if (queued)
+        {
+            flush();
+            return;
+        }
+
+        // Closed, so nothing was queued
+        for (auto &callback : callbacks)
+        {
+            if (callback)
+            {
+                callback(Reply::error("IOERR connection closed"));
+            }
+        }
+    }
+
+    void Connection::flush()
+    {
+        std::string out;
+        for (;;)
+        {
+            {
+                std::lock_guard lock(mutex_);
+                if (outbox_.empty() || closed_.load(std::memory_order_relaxed))
+                {
+                    writing_ = false;
+                    return;
+                }
+                out.swap(outbox_);
+                outbox_.clear();
+            }
+
+            if (!send_all(fd_, out))
+            {
+                fail(std::string("send: ") + strerror(errno));
+                std::lock_guard lock(mutex_);
+                writing_ = false;
+                return;
+            }
+            out.clear();
+        }
+    }
+
+    void Connection::read_loop()
+    {
+        std::string buffer;
+        size_t start = 0; // first unparsed byte
+        char chunk[64 * 1024];
+        std::string reason = "connection closed";
+
+        for (;;)
+        {
+            ssize_t n = recv(fd_, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                break;
+            }
+            buffer.append(chunk, n);
+
+            try
+            {
+                Reply reply;
+                while (size_t used = parse_reply(std::string_view(buffer).substr(start), reply))
+                {
+                    start += used;
+                    ReplyCallback callback;
+                    {
+                        std::lock_guard lock(mutex_);
+                        if (waiting_.empty())
+                        {
+                            throw ProtocolError("reply with no request waiting");
+                        }
+                        callback = std::move(waiting_.front());
+                        waiting_.pop_front();
+                    }
+                    outstanding_.fetch_sub(1, std::memory_order_relaxed);
+                    if (callback)
+                    {
+                        callback(std::move(reply));
+                    }
+                    reply = Reply();
+                }
+            }
+            catch (const ProtocolError &e)
+            {
+                reason = e.what();
+                break;
+            }
+
+            // Drop parsed bytes once they are the bulk of the buffer, so copies stay amortized
+            if (start > buffer.size() / 2)
+            {
+                buffer.erase(0, start);
+                start = 0;
+            }
+        }
+
+        fail(reason);
+    }
+
+    void Connection::fail(const std::string &reason)
+    {
+        std::deque<ReplyCallback> waiting;
+        {
+            std::lock_guard lock(mutex_);
+            closed_.store(true, std::memory_order_release);
+            waiting.swap(waiting_);
+            outbox_.clear();
+        }
+        shutdown(fd_, SHUT_RDWR);
+
+        outstanding_.fetch_sub(waiting.size(), std::memory_order_relaxed);
+        for (auto &callback : waiting)
+        {
+            if (callback)
+            {
+                callback(Reply::error("IOERR " + reason));
+            }
+        }
+    }
+
+    void Batch::add(const std::vector<std::string> &args, ReplyCallback callback)
+    {
+        check_command(args, in_multi_, true);
+        lines_ += encode_command(args);
+        callbacks_.push_back(std::move(callback));
+    }
+
+    std::future<Reply> Batch::add(const std::vector<std::string> &args)
+    {
+        auto promise = std::make_shared<std::promise<Reply>>();
+        auto future = promise->get_future();
+        add(args, fulfil(std::move(promise)));
+        return future;
+    }
+
+    Client::Client(ClientOptions options) : options_(std::move(options))
+    {
+        for (size_t i = 0; i < std::max<size_t>(options_.connections, 1); i++)
+        {
+            pool_.push_back(Connection::open(options_));
+        }
+    }
+
+    Client::~Client()
+    {
+        for (auto &connection : pool_)
+        {
+            connection->stop();
+        }
+    }
+
+    std::shared_ptr<Connection> Client::pick()
+    {
+        // Replaced connections are released after the pool is unlocked
+        std::vector<std::shared_ptr<Connection>> retired;
+        std::lock_guard lock(pool_mutex_);
+        std::shared_ptr<Connection> best;
+        for (auto &connection : pool_)
+        {
+            if (!connection->alive())
+            {
+                try
+                {
+                    auto fresh = Connection::open(options_);
+                    retired.push_back(std::exchange(connection, std::move(fresh)));
+                }
+                catch (const std::system_error &)
+                {
+                    continue; // still down, try again next time
+                }
+            }
+            if (!best || connection->outstanding() < best->outstanding())
+            {
+                best = connection;
+            }
+        }
+        // Nothing reachable: the request fails on a dead connection
+        return best ? best : pool_.front();
+    }
+
+    void Client::send(const std::vector<std::string> &args, ReplyCallback callback)
+    {
+        bool in_multi = false;
+        check_command(args, in_multi, false);
+        std::vector<ReplyCallback> callbacks;
+        callbacks.push_back(std::move(callback));
+        pick()->submit(encode_command(args), std::move(callbacks));
+    }
+
+    std::future<Reply> Client::send(const std::vector<std::string> &args)
+    {
+        auto promise = std::make_shared<std::promise<Reply>>();
+        auto future = promise->get_future();
+        send(args, fulfil(std::move(promise)));
+        return future;
+    }
+
+    void Client::execute(Batch &batch)
+    {
+        if (batch.in_multi_)
+        {
+            throw std::invalid_argument("batch ends inside MULTI");
+        }
+        if (batch.empty())
+        {
+            return;
+        }
+        pick()->submit(batch.lines_, std::move(batch.callbacks_));
+        batch = Batch();
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include "net/resp.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace kv
+{
+    // Runs on the connection's reader thread, in request order, and may be empty to ignore the
+    // reply. A lost connection completes every outstanding request with an Error reply
+    // starting "IOERR".
+    using ReplyCallback = std::function<void(Reply)>;
+
+    struct ClientOptions
+    {
+        std::string host = "127.0.0.1";
+        int port = 8080;
+        std::string unix_path; // connects here instead of host:port when set
+        size_t connections = 4;
+    };
+
+    // One socket shared by any number of threads. Requests are appended to an outbox and one
+    // caller at a time writes it out, so requests from concurrent callers that arrive during a
+    // write go out together in the next one. A reader thread matches replies to callbacks in
+    // order, and holds a reference to the Connection until it exits, so the last reference may
+    // be dropped anywhere, callbacks included.
+    class Connection : public std::enable_shared_from_this<Connection>
+    {
+    public:
+        // Throws std::system_error if the server can't be reached
+        static std::shared_ptr<Connection> open(const ClientOptions &options);
+        ~Connection();
+
+        Connection(const Connection &) = delete;
+        Connection &operator=(const Connection &) = delete;
+
+        // lines holds callbacks.size() encoded commands, sent back to back
+        void submit(const std::string &lines, std::vector<ReplyCallback> callbacks);
+
+        bool alive() const { return !closed_.load(std::memory_order_acquire); }
+        size_t outstanding() const { return outstanding_.load(std::memory_order_relaxed); }
+
+        // Closes the socket, which fails what is outstanding, and waits for the reader thread
+        // unless called from it
+        void stop();
+
+    private:
+        explicit Connection(const ClientOptions &options);
+
+        void flush();
+        void read_loop();
+        // Closes the connection and fails every outstanding request
+        void fail(const std::string &reason);
+
+        int fd_;
+        std::mutex mutex_;
+        std::string outbox_;                // encoded, not yet written
+        std::deque<ReplyCallback> waiting_; // one per request written or in the outbox
+        bool writing_ = false;              // a caller is in flush()
+        std::atomic<bool> closed_{false};
+        std::atomic<size_t> outstanding_{0};
+        std::thread reader_; // runs read_loop, holding a reference to this
+    };
+
+    // Commands sent together, on one connection and in one contiguous run, so nothing from
+    // other callers lands in between. MULTI ... EXEC is only accepted inside a batch.
+    class Batch
+    {
+    public:
+        // Throws std::invalid_argument for a command the line protocol can't carry or that
+        // needs a connection of its own (SUBSCRIBE, PSYNC, ...)
+        void add(const std::vector<std::string> &args, ReplyCallback callback);
+        std::future<Reply> add(const std::vector<std::string> &args);
+
+        size_t size() const { return callbacks_.size(); }
+        bool empty() const { return callbacks_.empty(); }
+
+    private:
+        friend class Client;
+
+        std::string lines_;
+        std::vector<ReplyCallback> callbacks_;
+        bool in_multi_ = false;
+    };
+
+    // A pool of pipelined connections. Each request goes to the live connection with the
+    // fewest replies outstanding; a dead one is reopened the next time it would be picked.
+    // Blocking commands (BZPOPMIN) hold up everything behind them on their connection.
+    class Client
+    {
+    public:
+        // Opens options.connections connections up front; throws std::system_error on failure
+        explicit Client(ClientOptions options = ClientOptions());
+        // Fails what is outstanding; every callback has run by the time it returns
+        ~Client();
+
+        Client(const Client &) = delete;
+        Client &operator=(const Client &) = delete;
+
+        void send(const std::vector<std::string> &args, ReplyCallback callback);
+        std::future<Reply> send(const std::vector<std::string> &args);
+        Reply call(const std::vector<std::string> &args) { return send(args).get(); }
+
+        // Sends the batch and leaves it empty. Throws std::invalid_argument if it ends inside MULTI.
+        void execute(Batch &batch);
+
+    private:
+        std::shared_ptr<Connection> pick();
+
+        ClientOptions options_;
+        std::mutex pool_mutex_;
+        std::vector<std::shared_ptr<Connection>> pool_;
+    };
+}
@@ -0,0 +1,122 @@
+#include "bloom_filter.h"
+#include "hashing.h"
+#include <algorithm>
+#include <cmath>
+
+namespace kv
+{
+    namespace
+    {
+        // One odd multiplier per word, so each word gets a different bit from the same key
+        constexpr uint32_t kSalts[8] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                        0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+        struct Masks
+        {
+            uint32_t words[8];
+        };
+
+        Masks masksFor(uint64_t hash)
+        {
+            Masks masks;
+            uint32_t key = static_cast<uint32_t>(hash);
+            for (int i = 0; i < 8; i++)
+            {
+                masks.words[i] = uint32_t(1) << ((key * kSalts[i]) >> 27);
+            }
+            return masks;
+        }
+    }
+
+    BloomFilter::BloomFilter(size_t capacity, double error_rate)
+    {
+        // Bits per item for k = 8 bits set per item
+        double bits = -8.0 * static_cast<double>(std::max<size_t>(capacity, 1)) / std::log(1.0 - std::pow(error_rate, 1.0 / 8));
+        size_t blocks = static_cast<size_t>(std::ceil(bits / (8 * sizeof(Block))));
+        blocks_.assign(std::max<size_t>(blocks, 1), Block{});
+    }
+
+    BloomFilter::Block &BloomFilter::blockFor(uint64_t hash)
+    {
+        // Upper 32 bits scaled onto the block count, no division
+        return blocks_[((hash >> 32) * blocks_.size()) >> 32];
+    }
+
+    const BloomFilter::Block &BloomFilter::blockFor(uint64_t hash) const
+    {
+        return blocks_[((hash >> 32) * blocks_.size()) >> 32];
+    }
+
+    bool BloomFilter::add(std::string_view item)
+    {
+        uint64_t hash = hash64(item);
+        Masks masks = masksFor(hash);
+        Block &block = blockFor(hash);
+
+        uint32_t missing = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            missing |= masks.words[i] & ~block.words[i];
+            block.words[i] |= masks.words[i];
+        }
+        return missing != 0;
+    }
+
+    bool BloomFilter::contains(std::string_view item) const
+    {
+        uint64_t hash = hash64(item);
+        Masks masks = masksFor(hash);
+        const Block &block = blockFor(hash);
+
+        uint32_t missing = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            missing |= masks.words[i] & ~block.words[i];
+        }
+        return missing == 0;
+    }
+
+    std::string BloomFilter::serialize() const
+    {
+        // 'B' then every word, little-endian
+        std::string out;
+        out.reserve(1 + bytes());
+        out.push_back('B');
+        for (const Block &block : blocks_)
+        {
+            for (uint32_t word : block.words)
+            {
+                for (int shift = 0; shift < 32; shift += 8)
+                {
+                    out.push_back(static_cast<char>(word >> shift));
+                }
+            }
+        }
+        return out;
+    }
+
+    std::optional<BloomFilter> BloomFilter::deserialize(std::string_view bytes)
+    {
+        if (bytes.empty() || bytes[0] != 'B' || (bytes.size() - 1) % sizeof(Block) != 0 || bytes.size() == 1)
+        {
+            return std::nullopt;
+        }
+
+        BloomFilter filter(1);
+        filter.blocks_.assign((bytes.size() - 1) / sizeof(Block), Block{});
+
+        size_t pos = 1;
+        for (Block &block : filter.blocks_)
+        {
+            for (uint32_t &word : block.words)
+            {
+                word = 0;
+                for (int shift = 0; shift < 32; shift += 8)
+                {
+                    word |= uint32_t(static_cast<unsigned char>(bytes[pos++])) << shift;
+                }
+            }
+        }
+        return filter;
+    }
+}
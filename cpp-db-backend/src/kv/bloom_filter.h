@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kv {
+    // Split block Bloom filter: an item's hash picks one 32-byte block, then sets one bit in
+    // each of the block's eight 32-bit words. A lookup touches a single cache line, and the
+    // eight word masks are independent multiply/shifts that the compiler can do in SIMD lanes.
+    class BloomFilter {
+        public:
+            static constexpr size_t kDefaultCapacity = 10000;
+            static constexpr double kDefaultErrorRate = 0.01;
+
+            // Sized so that after capacity items a lookup of a new one is a false positive
+            // with probability error_rate (0 < error_rate < 1)
+            explicit BloomFilter(size_t capacity = kDefaultCapacity, double error_rate = kDefaultErrorRate);
+
+            // Returns true if the item wasn't already (possibly) present
+            bool add(std::string_view item);
+            bool contains(std::string_view item) const;
+
+            size_t bytes() const { return blocks_.size() * sizeof(Block); }
+
+            // Compact encoding for snapshots and replication
+            std::string serialize() const;
+            static std::optional<BloomFilter> deserialize(std::string_view bytes);
+
+        private:
+            struct alignas(32) Block {
+                uint32_t words[8];
+            };
+
+            Block &blockFor(uint64_t hash);
+            const Block &blockFor(uint64_t hash) const;
+
+            std::vector<Block> blocks_;
+    };
+}
@@ -0,0 +1,146 @@
+#include "change_ring.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace kv
+{
+    ChangeRing::ChangeRing(size_t capacity) : buf_(capacity) {}
+
+    void ChangeRing::copy_in(uint64_t offset, const void *src, size_t len)
+    {
+        size_t pos = offset % buf_.size();
+        size_t first = std::min(len, buf_.size() - pos);
+        memcpy(buf_.data() + pos, src, first);
+        memcpy(buf_.data(), static_cast<const char *>(src) + first, len - first);
+    }
+
+    void ChangeRing::copy_out(uint64_t offset, void *dst, size_t len) const
+    {
+        size_t pos = offset % buf_.size();
+        size_t first = std::min(len, buf_.size() - pos);
+        memcpy(dst, buf_.data() + pos, first);
+        memcpy(static_cast<char *>(dst) + first, buf_.data(), len - first);
+    }
+
+    uint64_t ChangeRing::append(std::atomic<uint64_t> &seq_counter, const Mutation &m)
+    {
+        // Announce the append before taking a number; see wait_for_appends
+        uint64_t ticket = started_.load(std::memory_order_relaxed) + 1;
+        started_.store(ticket, std::memory_order_seq_cst);
+        uint64_t seq = seq_counter.fetch_add(1, std::memory_order_seq_cst);
+
+        Header h;
+        h.size = static_cast<uint32_t>(sizeof(Header) + m.key.size() + m.value.size() + m.field.size());
+        h.key_len = static_cast<uint32_t>(m.key.size());
+        h.value_len = static_cast<uint32_t>(m.value.size());
+        h.field_len = static_cast<uint32_t>(m.field.size());
+        h.seq = seq;
+        h.score = m.score;
+        h.ttl = m.ttl.count();
+        h.type = m.type;
+
+        if (h.size > buf_.size())
+        {
+            dropped_.store(seq, std::memory_order_release);
+            finished_.store(ticket, std::memory_order_release);
+            return seq;
+        }
+
+        // Reclaim whole records from the tail until the new one fits
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        while (head + h.size - tail > buf_.size())
+        {
+            Header old;
+            copy_out(tail, &old, sizeof(old));
+            dropped_.store(old.seq, std::memory_order_relaxed);
+            tail += old.size;
+        }
+
+        // Readers re-check tail_ after copying, so it has to move before the bytes do
+        tail_.store(tail, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        copy_in(head, &h, sizeof(h));
+        uint64_t pos = head + sizeof(h);
+        copy_in(pos, m.key.data(), m.key.size());
+        pos += m.key.size();
+        copy_in(pos, m.value.data(), m.value.size());
+        pos += m.value.size();
+        copy_in(pos, m.field.data(), m.field.size());
+
+        head_.store(head + h.size, std::memory_order_release);
+        finished_.store(ticket, std::memory_order_release);
+        return seq;
+    }
+
+    void ChangeRing::wait_for_appends() const
+    {
+        // An append whose number is below the caller's counter read announced itself first,
+        // so it is counted here; it only holds a shard lock for a copy, so this wait is short
+        uint64_t started = started_.load(std::memory_order_seq_cst);
+        while (finished_.load(std::memory_order_acquire) < started)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    bool ChangeRing::read(uint64_t from, uint64_t below, size_t max, std::vector<ChangeEvent> &out) const
+    {
+        size_t initial = out.size();
+        uint64_t head = head_.load(std::memory_order_acquire);
+        uint64_t offset = tail_.load(std::memory_order_acquire);
+
+        while (offset < head && out.size() - initial < max)
+        {
+            Header h;
+            copy_out(offset, &h, sizeof(h));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (tail_.load(std::memory_order_relaxed) > offset)
+            {
+                // Lapped by the writer: the header may be torn, start again from the new tail
+                out.resize(initial);
+                offset = tail_.load(std::memory_order_acquire);
+                continue;
+            }
+
+            if (h.seq >= below)
+            {
+                break;
+            }
+
+            if (h.seq >= from)
+            {
+                ChangeEvent e;
+                e.seq = h.seq;
+                e.type = h.type;
+                e.score = h.score;
+                e.ttl = std::chrono::seconds(h.ttl);
+                e.key.resize(h.key_len);
+                e.value.resize(h.value_len);
+                e.field.resize(h.field_len);
+
+                uint64_t pos = offset + sizeof(h);
+                copy_out(pos, e.key.data(), h.key_len);
+                pos += h.key_len;
+                copy_out(pos, e.value.data(), h.value_len);
+                pos += h.value_len;
+                copy_out(pos, e.field.data(), h.field_len);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (tail_.load(std::memory_order_relaxed) > offset)
+                {
+                    out.resize(initial);
+                    offset = tail_.load(std::memory_order_acquire);
+                    continue;
+                }
+                out.push_back(std::move(e));
+            }
+
+            offset += h.size;
+        }
+
+        return dropped_.load(std::memory_order_acquire) < from;
+    }
+}
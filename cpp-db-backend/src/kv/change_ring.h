@@ -0,0 +1,66 @@
+#pragma once
+#include "mutation.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace kv
+{
+    // A Mutation copied out of a ChangeRing, tagged with its sequence number
+    struct ChangeEvent
+    {
+        uint64_t seq;
+        Mutation::Type type;
+        std::string key;
+        std::string value;
+        double score = 0;
+        std::string field;
+        std::chrono::seconds ttl{0};
+    };
+
+    // Byte ring of the most recent changes made to one shard.
+    // There is a single writer (whoever holds the shard's write lock), so an append is just a
+    // copy into the ring. Readers never lock: they copy a record and then check that the
+    // writer hasn't reclaimed it in the meantime, like a seqlock.
+    class ChangeRing
+    {
+    public:
+        explicit ChangeRing(size_t capacity);
+
+        // Takes the next number from seq and appends m under it.
+        // Sequence numbers start at 1 and are unique across every ring sharing seq.
+        uint64_t append(std::atomic<uint64_t> &seq, const Mutation &m);
+
+        // Waits out appends that already took a number, so that afterwards every
+        // seq below a value read from the counter is visible here
+        void wait_for_appends() const;
+
+        // Copies up to max events with from <= seq < below into out, oldest first.
+        // Returns false if an event at or after from has already been overwritten.
+        bool read(uint64_t from, uint64_t below, size_t max, std::vector<ChangeEvent> &out) const;
+
+    private:
+        struct Header
+        {
+            uint32_t size; // whole record, header included
+            uint32_t key_len;
+            uint32_t value_len;
+            uint32_t field_len;
+            uint64_t seq;
+            double score;
+            int64_t ttl;
+            Mutation::Type type;
+        };
+
+        void copy_in(uint64_t offset, const void *src, size_t len);
+        void copy_out(uint64_t offset, void *dst, size_t len) const;
+
+        std::vector<char> buf_;
+        std::atomic<uint64_t> head_{0};      // end of the last complete record
+        std::atomic<uint64_t> tail_{0};      // start of the oldest record still held
+        std::atomic<uint64_t> dropped_{0};   // highest seq overwritten (or too big to hold)
+        std::atomic<uint64_t> started_{0};   // appends that took a sequence number
+        std::atomic<uint64_t> finished_{0};  // appends that are readable
+    };
+}
@@ -0,0 +1,182 @@
+#include "hash.h"
+
+namespace kv
+{
+    namespace
+    {
+        void appendVarint(std::string &out, size_t value)
+        {
+            while (value >= 0x80)
+            {
+                out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<char>(value));
+        }
+
+        size_t readVarint(const std::string &in, size_t &pos)
+        {
+            size_t value = 0;
+            int shift = 0;
+            unsigned char byte;
+
+            do
+            {
+                byte = static_cast<unsigned char>(in[pos++]);
+                value |= static_cast<size_t>(byte & 0x7f) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+
+            return value;
+        }
+
+        void appendString(std::string &out, const std::string &str)
+        {
+            appendVarint(out, str.size());
+            out += str;
+        }
+    }
+
+    std::optional<Hash::PackedEntry> Hash::findPacked(const std::string &field) const
+    {
+        size_t pos = 0;
+
+        while (pos < packed_.size())
+        {
+            PackedEntry entry;
+            entry.begin = pos;
+
+            size_t field_len = readVarint(packed_, pos);
+            size_t field_start = pos;
+            pos += field_len;
+
+            entry.value_begin = pos;
+            size_t value_len = readVarint(packed_, pos);
+            pos += value_len;
+            entry.end = pos;
+
+            if (field_len == field.size() && packed_.compare(field_start, field_len, field) == 0)
+            {
+                return entry;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    void Hash::promote()
+    {
+        for (auto &[field, value] : all())
+        {
+            table_.emplace(std::move(field), std::move(value));
+        }
+
+        packed_mode_ = false;
+        std::string().swap(packed_);
+        packed_count_ = 0;
+    }
+
+    bool Hash::set(const std::string &field, const std::string &value)
+    {
+        if (packed_mode_)
+        {
+            auto entry = findPacked(field);
+            bool too_long = field.size() > kMaxPackedLength || value.size() > kMaxPackedLength;
+            bool too_many = !entry && packed_count_ >= kMaxPackedEntries;
+
+            if (!too_long && !too_many)
+            {
+                if (entry)
+                {
+                    // Overwrite just the value part in place
+                    std::string encoded;
+                    appendString(encoded, value);
+                    packed_.replace(entry->value_begin, entry->end - entry->value_begin, encoded);
+                    return false;
+                }
+
+                appendString(packed_, field);
+                appendString(packed_, value);
+                packed_count_++;
+                return true;
+            }
+
+            promote();
+        }
+
+        auto [it, inserted] = table_.insert_or_assign(field, value);
+        return inserted;
+    }
+
+    std::optional<std::string> Hash::get(const std::string &field) const
+    {
+        if (packed_mode_)
+        {
+            auto entry = findPacked(field);
+            if (!entry)
+            {
+                return std::nullopt;
+            }
+
+            size_t pos = entry->value_begin;
+            size_t len = readVarint(packed_, pos);
+            return packed_.substr(pos, len);
+        }
+
+        auto it = table_.find(field);
+        if (it != table_.end())
+        {
+            return it->second;
+        }
+        return std::nullopt;
+    }
+
+    bool Hash::remove(const std::string &field)
+    {
+        if (packed_mode_)
+        {
+            auto entry = findPacked(field);
+            if (!entry)
+            {
+                return false;
+            }
+
+            packed_.erase(entry->begin, entry->end - entry->begin);
+            packed_count_--;
+            return true;
+        }
+
+        return table_.erase(field) > 0;
+    }
+
+    size_t Hash::size() const
+    {
+        return packed_mode_ ? packed_count_ : table_.size();
+    }
+
+    std::vector<std::pair<std::string, std::string>> Hash::all() const
+    {
+        std::vector<std::pair<std::string, std::string>> res;
+        res.reserve(size());
+
+        if (!packed_mode_)
+        {
+            res.assign(table_.begin(), table_.end());
+            return res;
+        }
+
+        size_t pos = 0;
+        while (pos < packed_.size())
+        {
+            size_t field_len = readVarint(packed_, pos);
+            std::string field = packed_.substr(pos, field_len);
+            pos += field_len;
+
+            size_t value_len = readVarint(packed_, pos);
+            res.emplace_back(std::move(field), packed_.substr(pos, value_len));
+            pos += value_len;
+        }
+
+        return res;
+    }
+}
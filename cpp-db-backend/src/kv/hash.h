@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <optional>
+#include <vector>
+
+namespace kv {
+    // Field/value map for the hash type.
+    // Small hashes are one packed byte string of [len][field][len][value]... entries (lengths
+    // are varints) scanned linearly, which costs a single allocation instead of a node per field.
+    // Past kMaxPackedEntries fields, or once a field/value is longer than kMaxPackedLength,
+    // it is promoted to an unordered_map for good.
+    class Hash {
+        public:
+            static constexpr size_t kMaxPackedEntries = 128;
+            static constexpr size_t kMaxPackedLength = 64;
+
+            // Returns true if field is new
+            bool set(const std::string &field, const std::string &value);
+            std::optional<std::string> get(const std::string &field) const;
+            bool remove(const std::string &field);
+            size_t size() const;
+            bool empty() const { return size() == 0; }
+
+            std::vector<std::pair<std::string, std::string>> all() const;
+
+            bool is_packed() const { return packed_mode_; }
+
+        private:
+            struct PackedEntry {
+                size_t begin;       // offset of the field's length prefix
+                size_t value_begin; // offset of the value's length prefix
+                size_t end;         // one past the value
+            };
+
+            std::optional<PackedEntry> findPacked(const std::string &field) const;
+            void promote();
+
+            bool packed_mode_ = true;
+            std::string packed_;
+            size_t packed_count_ = 0;
+            std::unordered_map<std::string, std::string> table_;
+    };
+}
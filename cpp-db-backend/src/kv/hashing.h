@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace kv
+{
+    // MurmurHash64A. Sketches persist their bits (snapshots, replication), so they need a hash
+    // that is the same on every build, which std::hash doesn't promise.
+    inline uint64_t hash64(std::string_view data, uint64_t seed = 0xadc83b19ULL)
+    {
+        const uint64_t m = 0xc6a4a7935bd1e995ULL;
+        const int r = 47;
+        uint64_t h = seed ^ (data.size() * m);
+
+        const char *p = data.data();
+        const char *end = p + (data.size() & ~size_t(7));
+        for (; p != end; p += 8)
+        {
+            uint64_t k;
+            std::memcpy(&k, p, sizeof(k));
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+            h ^= k;
+            h *= m;
+        }
+
+        switch (data.size() & 7)
+        {
+        case 7: h ^= uint64_t(static_cast<unsigned char>(p[6])) << 48; [[fallthrough]];
+        case 6: h ^= uint64_t(static_cast<unsigned char>(p[5])) << 40; [[fallthrough]];
+        case 5: h ^= uint64_t(static_cast<unsigned char>(p[4])) << 32; [[fallthrough]];
+        case 4: h ^= uint64_t(static_cast<unsigned char>(p[3])) << 24; [[fallthrough]];
+        case 3: h ^= uint64_t(static_cast<unsigned char>(p[2])) << 16; [[fallthrough]];
+        case 2: h ^= uint64_t(static_cast<unsigned char>(p[1])) << 8; [[fallthrough]];
+        case 1:
+            h ^= uint64_t(static_cast<unsigned char>(p[0]));
+            h *= m;
+        }
+
+        h ^= h >> r;
+        h *= m;
+        h ^= h >> r;
+        return h;
+    }
+}
@@ -0,0 +1,140 @@
+#include "hot_keys.h"
+#include "hashing.h"
+#include <algorithm>
+#include <limits>
+
+namespace kv
+{
+    HotKeys::HotKeys() : counts_(new std::atomic<uint32_t>[kDepth * kWidth]), hot_(std::make_shared<const std::unordered_set<std::string>>())
+    {
+        for (size_t i = 0; i < kDepth * kWidth; i++)
+        {
+            counts_[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void HotKeys::record(std::string_view key)
+    {
+        thread_local uint32_t tick = 0;
+        if (++tick % kSamplePeriod != 0)
+        {
+            return;
+        }
+
+        // Row d uses h1 + d * h2 (double hashing); the estimate is the smallest row count
+        uint64_t h = hash64(key);
+        uint32_t h1 = static_cast<uint32_t>(h);
+        uint32_t h2 = static_cast<uint32_t>(h >> 32) | 1;
+        uint32_t estimate = std::numeric_limits<uint32_t>::max();
+        for (size_t d = 0; d < kDepth; d++)
+        {
+            auto &counter = counts_[d * kWidth + (h1 + d * h2) % kWidth];
+            estimate = std::min(estimate, counter.fetch_add(1, std::memory_order_relaxed) + 1);
+        }
+
+        if ((samples_.fetch_add(1, std::memory_order_relaxed) + 1) % kDecayEvery == 0)
+        {
+            decay();
+        }
+
+        // Most samples stop here without touching the mutex
+        if (estimate >= admit_from_.load(std::memory_order_relaxed))
+        {
+            admit(key, estimate);
+        }
+    }
+
+    void HotKeys::admit(std::string_view key, uint32_t estimate)
+    {
+        std::lock_guard lock(mutex_);
+
+        auto it = std::find_if(top_.begin(), top_.end(), [&](const auto &e) { return e.first == key; });
+        if (it != top_.end())
+        {
+            it->second = std::max(it->second, estimate);
+        }
+        else if (top_.size() < kCapacity)
+        {
+            top_.emplace_back(std::string(key), estimate);
+        }
+        else
+        {
+            auto smallest = std::min_element(top_.begin(), top_.end(), [](const auto &a, const auto &b) { return a.second < b.second; });
+            if (smallest->second >= estimate)
+            {
+                return;
+            }
+            *smallest = {std::string(key), estimate};
+        }
+
+        if (top_.size() == kCapacity)
+        {
+            auto smallest = std::min_element(top_.begin(), top_.end(), [](const auto &a, const auto &b) { return a.second < b.second; });
+            admit_from_.store(smallest->second, std::memory_order_relaxed);
+        }
+        publish();
+    }
+
+    void HotKeys::decay()
+    {
+        // Races with concurrent increments only lose a few samples
+        for (size_t i = 0; i < kDepth * kWidth; i++)
+        {
+            counts_[i].store(counts_[i].load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+        }
+
+        std::lock_guard lock(mutex_);
+        for (auto &entry : top_)
+        {
+            entry.second /= 2;
+        }
+        top_.erase(std::remove_if(top_.begin(), top_.end(), [](const auto &e) { return e.second == 0; }), top_.end());
+        admit_from_.store(0, std::memory_order_relaxed); // refilled as the list fills up again
+        publish();
+    }
+
+    void HotKeys::publish()
+    {
+        auto current = std::atomic_load(&hot_);
+        auto next = std::make_shared<std::unordered_set<std::string>>();
+        for (const auto &[key, samples] : top_)
+        {
+            if (samples >= kHotSamples)
+            {
+                next->insert(key);
+            }
+        }
+
+        if (*next != *current)
+        {
+            std::atomic_store(&hot_, std::shared_ptr<const std::unordered_set<std::string>>(std::move(next)));
+        }
+    }
+
+    std::vector<std::pair<std::string, uint64_t>> HotKeys::top(size_t count) const
+    {
+        std::vector<std::pair<std::string, uint64_t>> res;
+        {
+            std::lock_guard lock(mutex_);
+            for (const auto &[key, samples] : top_)
+            {
+                res.emplace_back(key, uint64_t(samples) * kSamplePeriod);
+            }
+        }
+
+        std::sort(res.begin(), res.end(), [](const auto &a, const auto &b) {
+            return a.second > b.second || (a.second == b.second && a.first < b.first);
+        });
+        if (res.size() > count)
+        {
+            res.resize(count);
+        }
+        return res;
+    }
+
+    bool HotKeys::is_hot(const std::string &key) const
+    {
+        auto hot = std::atomic_load(&hot_);
+        return hot->count(key) > 0;
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace kv {
+    // Sampled hot-key tracker: one read in kSamplePeriod is counted in a count-min sketch of
+    // relaxed atomic counters, and keys whose estimate beats the smallest of the current
+    // top kCapacity join that list. Every kDecayEvery samples all counts are halved, so the
+    // list follows recent traffic rather than all-time totals.
+    class HotKeys {
+        public:
+            static constexpr uint32_t kSamplePeriod = 16;
+            static constexpr size_t kCapacity = 32;
+            // A top key is hot (worth caching) from this many samples, ~1000 reads per decay window
+            static constexpr uint32_t kHotSamples = 64;
+
+            HotKeys();
+
+            // Called on every read; cheap unless this call is the sampled one
+            void record(std::string_view key);
+
+            // Up to count keys, most read first, with estimated reads since the last decays
+            std::vector<std::pair<std::string, uint64_t>> top(size_t count) const;
+
+            // Lock-free check against the published hot set
+            bool is_hot(const std::string &key) const;
+
+        private:
+            static constexpr size_t kDepth = 4;
+            static constexpr size_t kWidth = 4096;
+            static constexpr uint64_t kDecayEvery = 1 << 16;
+
+            void admit(std::string_view key, uint32_t estimate);
+            void decay();
+            // Caller holds mutex_
+            void publish();
+
+            std::unique_ptr<std::atomic<uint32_t>[]> counts_; // kDepth rows of kWidth
+            std::atomic<uint64_t> samples_{0};
+            std::atomic<uint32_t> admit_from_{0}; // smallest top count once the list is full
+
+            mutable std::mutex mutex_; // guards top_
+            std::vector<std::pair<std::string, uint32_t>> top_;
+            std::shared_ptr<const std::unordered_set<std::string>> hot_; // std::atomic_load/atomic_store
+    };
+}
@@ -0,0 +1,263 @@
+#include "hyperloglog.h"
+#include "hashing.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace kv
+{
+    namespace
+    {
+        // Ranks run from 1 to kMaxRank; 0 means the register was never hit
+        constexpr int kMaxRank = 64 - HyperLogLog::kPrecision + 1;
+
+        // dst[i] = max(dst[i], src[i]), 16 registers per instruction
+        void maxInto(uint8_t *dst, const uint8_t *src, size_t n)
+        {
+            size_t i = 0;
+#if defined(__SSE2__)
+            for (; i + 16 <= n; i += 16)
+            {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_max_epu8(a, b));
+            }
+#elif defined(__ARM_NEON)
+            for (; i + 16 <= n; i += 16)
+            {
+                vst1q_u8(dst + i, vmaxq_u8(vld1q_u8(dst + i), vld1q_u8(src + i)));
+            }
+#endif
+            for (; i < n; i++)
+            {
+                dst[i] = std::max(dst[i], src[i]);
+            }
+        }
+
+        // Helpers of Ertl's estimator ("New cardinality estimation algorithms for
+        // HyperLogLog sketches", 2017), which needs no bias tables at any cardinality
+        double sigma(double x)
+        {
+            if (x == 1.0)
+            {
+                return std::numeric_limits<double>::infinity();
+            }
+            double y = 1.0;
+            double z = x;
+            double prev;
+            do
+            {
+                x *= x;
+                prev = z;
+                z += x * y;
+                y += y;
+            } while (z != prev);
+            return z;
+        }
+
+        double tau(double x)
+        {
+            if (x == 0.0 || x == 1.0)
+            {
+                return 0.0;
+            }
+            double y = 1.0;
+            double z = 1.0 - x;
+            double prev;
+            do
+            {
+                x = std::sqrt(x);
+                prev = z;
+                y *= 0.5;
+                z -= (1.0 - x) * (1.0 - x) * y;
+            } while (z != prev);
+            return z / 3.0;
+        }
+    }
+
+    bool HyperLogLog::add(std::string_view element)
+    {
+        uint64_t h = hash64(element);
+        uint32_t index = static_cast<uint32_t>(h & (kRegisters - 1));
+        // The sentinel bit caps the rank at kMaxRank
+        uint64_t rest = (h >> kPrecision) | (uint64_t(1) << (64 - kPrecision));
+        uint8_t rank = static_cast<uint8_t>(__builtin_ctzll(rest) + 1);
+        return raise(index, rank);
+    }
+
+    bool HyperLogLog::raise(uint32_t index, uint8_t rank)
+    {
+        if (!is_sparse())
+        {
+            if (dense_[index] >= rank)
+            {
+                return false;
+            }
+            dense_[index] = rank;
+            return true;
+        }
+
+        auto it = std::lower_bound(sparse_.begin(), sparse_.end(), index << 8);
+        if (it != sparse_.end() && (*it >> 8) == index)
+        {
+            if ((*it & 0xff) >= rank)
+            {
+                return false;
+            }
+            *it = index << 8 | rank;
+            return true;
+        }
+
+        if (sparse_.size() >= kMaxSparseEntries)
+        {
+            promote();
+            dense_[index] = rank;
+            return true;
+        }
+
+        sparse_.insert(it, index << 8 | rank);
+        return true;
+    }
+
+    void HyperLogLog::promote()
+    {
+        dense_.assign(kRegisters, 0);
+        for (uint32_t entry : sparse_)
+        {
+            dense_[entry >> 8] = static_cast<uint8_t>(entry & 0xff);
+        }
+        std::vector<uint32_t>().swap(sparse_);
+    }
+
+    void HyperLogLog::merge(const HyperLogLog &other)
+    {
+        if (other.is_sparse())
+        {
+            for (uint32_t entry : other.sparse_)
+            {
+                raise(entry >> 8, static_cast<uint8_t>(entry & 0xff));
+            }
+            return;
+        }
+
+        if (is_sparse())
+        {
+            promote();
+        }
+        maxInto(dense_.data(), other.dense_.data(), kRegisters);
+    }
+
+    uint64_t HyperLogLog::count() const
+    {
+        // How many registers hold each rank
+        uint32_t histogram[kMaxRank + 1] = {0};
+        if (is_sparse())
+        {
+            histogram[0] = static_cast<uint32_t>(kRegisters - sparse_.size());
+            for (uint32_t entry : sparse_)
+            {
+                histogram[entry & 0xff]++;
+            }
+        }
+        else
+        {
+            for (uint8_t rank : dense_)
+            {
+                histogram[rank]++;
+            }
+        }
+
+        const double m = static_cast<double>(kRegisters);
+        double z = m * tau((m - histogram[kMaxRank]) / m);
+        for (int k = kMaxRank - 1; k >= 1; k--)
+        {
+            z = 0.5 * (z + histogram[k]);
+        }
+        z += m * sigma(histogram[0] / m);
+
+        const double alpha = 0.5 / std::log(2.0);
+        return static_cast<uint64_t>(std::llround(alpha * m * m / z));
+    }
+
+    std::string HyperLogLog::serialize() const
+    {
+        std::string out;
+        if (is_sparse())
+        {
+            // 'S' then three bytes per entry: 14-bit index, 6-bit rank
+            out.reserve(1 + 3 * sparse_.size());
+            out.push_back('S');
+            for (uint32_t entry : sparse_)
+            {
+                uint32_t packed = (entry >> 8) << 6 | (entry & 0x3f);
+                out.push_back(static_cast<char>(packed >> 16));
+                out.push_back(static_cast<char>(packed >> 8));
+                out.push_back(static_cast<char>(packed));
+            }
+            return out;
+        }
+
+        out.reserve(1 + kRegisters);
+        out.push_back('D');
+        out.append(reinterpret_cast<const char *>(dense_.data()), dense_.size());
+        return out;
+    }
+
+    std::optional<HyperLogLog> HyperLogLog::deserialize(std::string_view bytes)
+    {
+        if (bytes.empty())
+        {
+            return std::nullopt;
+        }
+
+        HyperLogLog hll;
+        std::string_view body = bytes.substr(1);
+
+        if (bytes[0] == 'D')
+        {
+            if (body.size() != kRegisters)
+            {
+                return std::nullopt;
+            }
+            hll.dense_.assign(body.begin(), body.end());
+            for (uint8_t rank : hll.dense_)
+            {
+                if (rank > kMaxRank)
+                {
+                    return std::nullopt;
+                }
+            }
+            return hll;
+        }
+
+        if (bytes[0] != 'S' || body.size() % 3 != 0 || body.size() / 3 > kMaxSparseEntries)
+        {
+            return std::nullopt;
+        }
+
+        hll.sparse_.reserve(body.size() / 3);
+        for (size_t i = 0; i < body.size(); i += 3)
+        {
+            uint32_t packed = uint32_t(static_cast<unsigned char>(body[i])) << 16 |
+                              uint32_t(static_cast<unsigned char>(body[i + 1])) << 8 |
+                              uint32_t(static_cast<unsigned char>(body[i + 2]));
+            uint32_t index = packed >> 6;
+            uint32_t rank = packed & 0x3f;
+
+            // Strictly increasing indexes, no empty registers
+            if (index >= kRegisters || rank == 0 || rank > kMaxRank ||
+                (!hll.sparse_.empty() && (hll.sparse_.back() >> 8) >= index))
+            {
+                return std::nullopt;
+            }
+            hll.sparse_.push_back(index << 8 | rank);
+        }
+        return hll;
+    }
+}
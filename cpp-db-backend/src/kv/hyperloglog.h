@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kv {
+    // Cardinality estimate in at most 16 KB, with a standard error of about 0.8%.
+    // Each element's 64-bit hash picks one of 2^14 registers (low bits) and a rank (position of
+    // the lowest set bit in the rest); a register keeps the highest rank seen.
+    // Small sketches are a sorted vector of the non-zero registers. Past kMaxSparseEntries of
+    // them it is promoted to one byte per register for good, which merges with SIMD max.
+    class HyperLogLog {
+        public:
+            static constexpr int kPrecision = 14;
+            static constexpr size_t kRegisters = size_t(1) << kPrecision;
+            static constexpr size_t kMaxSparseEntries = 1024; // 4 KB, a quarter of the dense form
+
+            // Returns true if a register changed
+            bool add(std::string_view element);
+            uint64_t count() const;
+            // Register-wise max: afterwards this counts the union of both
+            void merge(const HyperLogLog &other);
+
+            bool is_sparse() const { return dense_.empty(); }
+
+            // Compact encoding for snapshots and replication
+            std::string serialize() const;
+            static std::optional<HyperLogLog> deserialize(std::string_view bytes);
+
+        private:
+            // Raises register index to at least rank; returns true if it changed
+            bool raise(uint32_t index, uint8_t rank);
+            void promote();
+
+            std::vector<uint32_t> sparse_; // index << 8 | rank, sorted by index
+            std::vector<uint8_t> dense_;   // one byte per register, empty while sparse
+    };
+}
@@ -0,0 +1,264 @@
+#include "key_index.h"
+#include <algorithm>
+#include <iterator>
+
+namespace kv
+{
+    namespace
+    {
+        constexpr size_t kMinFill = KeyIndex::kFanout / 2;
+    }
+
+    KeyIndex::Cursor::Cursor(const Node *leaf, size_t pos) : leaf_(leaf), pos_(pos)
+    {
+        // Past the end of a leaf means the start of the next one; only the root leaf can be empty
+        while (leaf_ != nullptr && pos_ >= leaf_->keys.size())
+        {
+            leaf_ = leaf_->next;
+            pos_ = 0;
+        }
+    }
+
+    void KeyIndex::Cursor::next()
+    {
+        *this = Cursor(leaf_, pos_ + 1);
+    }
+
+    KeyIndex::KeyIndex() : root_(std::make_unique<Node>(true)) {}
+
+    KeyIndex::~KeyIndex() = default;
+
+    void KeyIndex::clear()
+    {
+        root_ = std::make_unique<Node>(true);
+        size_ = 0;
+    }
+
+    size_t KeyIndex::childIndex(const Node &node, std::string_view key)
+    {
+        // Keys equal to a separator live in the child to its right
+        return std::upper_bound(node.keys.begin(), node.keys.end(), key) - node.keys.begin();
+    }
+
+    size_t KeyIndex::height() const
+    {
+        size_t levels = 1;
+        for (const Node *node = root_.get(); !node->leaf; node = node->children[0].get())
+        {
+            levels++;
+        }
+        return levels;
+    }
+
+    bool KeyIndex::contains(std::string_view key) const
+    {
+        Cursor cursor = seek(key);
+        return cursor.valid() && cursor.key() == key;
+    }
+
+    KeyIndex::Cursor KeyIndex::begin() const
+    {
+        const Node *node = root_.get();
+        while (!node->leaf)
+        {
+            node = node->children[0].get();
+        }
+        return Cursor(node, 0);
+    }
+
+    KeyIndex::Cursor KeyIndex::seek(std::string_view key, bool exclusive) const
+    {
+        const Node *node = root_.get();
+        while (!node->leaf)
+        {
+            node = node->children[childIndex(*node, key)].get();
+        }
+
+        auto it = exclusive ? std::upper_bound(node->keys.begin(), node->keys.end(), key)
+                            : std::lower_bound(node->keys.begin(), node->keys.end(), key);
+        return Cursor(node, it - node->keys.begin());
+    }
+
+    bool KeyIndex::insert(const std::string &key)
+    {
+        bool inserted = false;
+        if (auto split = insertInto(*root_, key, inserted))
+        {
+            // The root split: the tree grows a level
+            auto root = std::make_unique<Node>(false);
+            root->keys.push_back(std::move(split->separator));
+            root->children.push_back(std::move(root_));
+            root->children.push_back(std::move(split->right));
+            root_ = std::move(root);
+        }
+
+        size_ += inserted;
+        return inserted;
+    }
+
+    std::unique_ptr<KeyIndex::Split> KeyIndex::insertInto(Node &node, const std::string &key, bool &inserted)
+    {
+        if (node.leaf)
+        {
+            auto it = std::lower_bound(node.keys.begin(), node.keys.end(), key);
+            if (it != node.keys.end() && *it == key)
+            {
+                return nullptr;
+            }
+            node.keys.insert(it, key);
+            inserted = true;
+
+            if (node.keys.size() <= kFanout)
+            {
+                return nullptr;
+            }
+
+            auto right = std::make_unique<Node>(true);
+            auto middle = node.keys.begin() + node.keys.size() / 2;
+            right->keys.assign(std::make_move_iterator(middle), std::make_move_iterator(node.keys.end()));
+            node.keys.erase(middle, node.keys.end());
+            right->next = node.next;
+            node.next = right.get();
+
+            std::string separator = right->keys.front();
+            return std::make_unique<Split>(Split{std::move(separator), std::move(right)});
+        }
+
+        size_t i = childIndex(node, key);
+        auto split = insertInto(*node.children[i], key, inserted);
+        if (!split)
+        {
+            return nullptr;
+        }
+
+        node.keys.insert(node.keys.begin() + i, std::move(split->separator));
+        node.children.insert(node.children.begin() + i + 1, std::move(split->right));
+        if (node.children.size() <= kFanout)
+        {
+            return nullptr;
+        }
+
+        // The middle separator moves up; the keys either side of it stay with their children
+        auto right = std::make_unique<Node>(false);
+        size_t middle = node.keys.size() / 2;
+        std::string separator = std::move(node.keys[middle]);
+        right->keys.assign(std::make_move_iterator(node.keys.begin() + middle + 1), std::make_move_iterator(node.keys.end()));
+        right->children.assign(std::make_move_iterator(node.children.begin() + middle + 1), std::make_move_iterator(node.children.end()));
+        node.keys.resize(middle);
+        node.children.resize(middle + 1);
+        return std::make_unique<Split>(Split{std::move(separator), std::move(right)});
+    }
+
+    bool KeyIndex::erase(const std::string &key)
+    {
+        if (!eraseFrom(*root_, key))
+        {
+            return false;
+        }
+
+        // A root left with a single child hands over to it: the tree shrinks a level
+        if (!root_->leaf && root_->children.size() == 1)
+        {
+            root_ = std::move(root_->children[0]);
+        }
+        size_--;
+        return true;
+    }
+
+    bool KeyIndex::eraseFrom(Node &node, const std::string &key)
+    {
+        if (node.leaf)
+        {
+            auto it = std::lower_bound(node.keys.begin(), node.keys.end(), key);
+            if (it == node.keys.end() || *it != key)
+            {
+                return false;
+            }
+            node.keys.erase(it);
+            return true;
+        }
+
+        size_t i = childIndex(node, key);
+        if (!eraseFrom(*node.children[i], key))
+        {
+            return false;
+        }
+
+        if (fill(*node.children[i]) < kMinFill)
+        {
+            rebalance(node, i);
+        }
+        return true;
+    }
+
+    void KeyIndex::rebalance(Node &node, size_t i)
+    {
+        Node &child = *node.children[i];
+
+        // Borrow from a sibling that can spare one, otherwise merge with it
+        if (i > 0 && fill(*node.children[i - 1]) > kMinFill)
+        {
+            Node &left = *node.children[i - 1];
+            if (child.leaf)
+            {
+                child.keys.insert(child.keys.begin(), std::move(left.keys.back()));
+                left.keys.pop_back();
+                node.keys[i - 1] = child.keys.front();
+            }
+            else
+            {
+                child.keys.insert(child.keys.begin(), std::move(node.keys[i - 1]));
+                child.children.insert(child.children.begin(), std::move(left.children.back()));
+                node.keys[i - 1] = std::move(left.keys.back());
+                left.keys.pop_back();
+                left.children.pop_back();
+            }
+        }
+        else if (i + 1 < node.children.size() && fill(*node.children[i + 1]) > kMinFill)
+        {
+            Node &right = *node.children[i + 1];
+            if (child.leaf)
+            {
+                child.keys.push_back(std::move(right.keys.front()));
+                right.keys.erase(right.keys.begin());
+                node.keys[i] = right.keys.front();
+            }
+            else
+            {
+                child.keys.push_back(std::move(node.keys[i]));
+                child.children.push_back(std::move(right.children.front()));
+                node.keys[i] = std::move(right.keys.front());
+                right.keys.erase(right.keys.begin());
+                right.children.erase(right.children.begin());
+            }
+        }
+        else if (i > 0)
+        {
+            merge(node, i - 1);
+        }
+        else if (i + 1 < node.children.size())
+        {
+            merge(node, i);
+        }
+    }
+
+    void KeyIndex::merge(Node &node, size_t i)
+    {
+        Node &left = *node.children[i];
+        Node &right = *node.children[i + 1];
+
+        if (left.leaf)
+        {
+            left.next = right.next;
+        }
+        else
+        {
+            left.keys.push_back(std::move(node.keys[i]));
+            std::move(right.children.begin(), right.children.end(), std::back_inserter(left.children));
+        }
+        std::move(right.keys.begin(), right.keys.end(), std::back_inserter(left.keys));
+
+        node.keys.erase(node.keys.begin() + i);
+        node.children.erase(node.children.begin() + i + 1);
+    }
+}
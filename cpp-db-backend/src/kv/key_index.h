@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kv {
+    // Ordered set of key names: a B+tree with up to kFanout keys per leaf and kFanout
+    // children per inner node, leaves linked in key order for range scans. Nodes are kept
+    // at least half full, merging or borrowing from a sibling on erase.
+    class KeyIndex {
+        private:
+            struct Node {
+                bool leaf;
+                std::vector<std::string> keys; // inner: keys[i] separates children[i] < keys[i] <= children[i + 1]
+                std::vector<std::unique_ptr<Node>> children; // inner nodes only
+                Node *next = nullptr; // leaves only: the following leaf
+
+                explicit Node(bool leaf) : leaf(leaf) {}
+            };
+
+        public:
+            static constexpr size_t kFanout = 64;
+
+            // Position in key order; invalidated by any insert or erase
+            class Cursor {
+                public:
+                    bool valid() const { return leaf_ != nullptr; }
+                    const std::string &key() const { return leaf_->keys[pos_]; }
+                    void next();
+
+                private:
+                    friend class KeyIndex;
+                    Cursor(const Node *leaf, size_t pos);
+
+                    const Node *leaf_;
+                    size_t pos_;
+            };
+
+            KeyIndex();
+            ~KeyIndex();
+
+            KeyIndex(const KeyIndex &) = delete;
+            KeyIndex &operator=(const KeyIndex &) = delete;
+
+            // True if key is new
+            bool insert(const std::string &key);
+            // True if key was present
+            bool erase(const std::string &key);
+            bool contains(std::string_view key) const;
+            size_t size() const { return size_; }
+            void clear();
+
+            Cursor begin() const;
+            // First key >= key, or > key with exclusive
+            Cursor seek(std::string_view key, bool exclusive = false) const;
+
+            // Levels from the root to the leaves, 1 for a single leaf
+            size_t height() const;
+
+        private:
+            struct Split {
+                std::string separator;
+                std::unique_ptr<Node> right;
+            };
+
+            static size_t childIndex(const Node &node, std::string_view key);
+            static size_t fill(const Node &node) { return node.leaf ? node.keys.size() : node.children.size(); }
+            // Returns the right half if node overflowed
+            std::unique_ptr<Split> insertInto(Node &node, const std::string &key, bool &inserted);
+            bool eraseFrom(Node &node, const std::string &key);
+            // Refills node.children[i] after it fell below half full
+            void rebalance(Node &node, size_t i);
+            // Moves children[i + 1] into children[i]
+            void merge(Node &node, size_t i);
+
+            std::unique_ptr<Node> root_;
+            size_t size_ = 0;
+    };
+}
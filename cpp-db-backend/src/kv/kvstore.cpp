@@ -1,66 +1,611 @@
 #include "kv/kvstore.h"
+#include <algorithm>
 #include <functional>
+#include <mutex>
+#include <queue>
 
 namespace kv {
-    KVStore::KVStore(size_t shards) : num_shards_(shards), shards_(shards) {}
+    namespace {
+        // Shards whose write locks this thread holds inside KVStore::atomically
+        struct HeldShards {
+            const KVStore* store = nullptr;
+            std::vector<bool> held;
+        };
+        thread_local HeldShards tx_held;
+
+        template <typename Shard>
+        bool isExpired(const Shard& shard, const std::string& key) {
+            if (shard.expires.empty()) {
+                return false;
+            }
+            auto it = shard.expires.find(key);
+            return it != shard.expires.end() && it->second <= std::chrono::steady_clock::now();
+        }
+
+        // Typed lookup: nullptr if the key is missing or expired, WrongTypeError if it holds another type
+        template <typename T, typename Shard>
+        auto findAs(Shard& shard, const std::string& key) -> decltype(std::get_if<T>(&shard.keyspace.begin()->second)) {
+            auto it = shard.keyspace.find(key);
+            if (it == shard.keyspace.end() || isExpired(shard, key)) {
+                return nullptr;
+            }
+
+            auto* value = std::get_if<T>(&it->second);
+            if (value == nullptr) {
+                throw WrongTypeError();
+            }
+            return value;
+        }
+
+        // Every key a shard gains or loses goes through these three, which keep the key index in
+        // step. Erasing also drops the key's TTL, so a key emptied any way can't pass one on.
+        template <typename T, typename Shard>
+        T& findOrCreate(Shard& shard, const std::string& key) {
+            auto [it, created] = shard.keyspace.try_emplace(key, std::in_place_type<T>);
+            if (created && shard.index) {
+                shard.index->insert(key);
+            }
+
+            auto* value = std::get_if<T>(&it->second);
+            if (value == nullptr) {
+                throw WrongTypeError();
+            }
+            return *value;
+        }
+
+        template <typename Shard, typename V>
+        void assignKey(Shard& shard, const std::string& key, V&& value) {
+            shard.keyspace.insert_or_assign(key, std::forward<V>(value));
+            if (shard.index) {
+                shard.index->insert(key);
+            }
+        }
+
+        template <typename Shard>
+        bool eraseKey(Shard& shard, const std::string& key) {
+            if (shard.keyspace.erase(key) == 0) {
+                return false;
+            }
+            shard.expires.erase(key);
+            if (shard.index) {
+                shard.index->erase(key);
+            }
+            return true;
+        }
+    }
+
+    // Locks a shard, or the shards a key may be in, skipping any the calling thread already
+    // holds through atomically()
+    template <typename Lock>
+    class KVStore::ShardLock {
+    public:
+        ShardLock(const KVStore& store, size_t shard_index) : store_(store), index_(shard_index) {
+            lock(shard_index);
+        }
+
+        // While resharding, a key still in transit has two homes; both are locked (in shard
+        // order), and index() is whichever holds it. Routing that changed before the locks
+        // were taken is re-read.
+        ShardLock(const KVStore& store, const std::string& key) : store_(store) {
+            for (;;) {
+                uint64_t epoch = store.routing_epoch_.load(std::memory_order_acquire);
+                auto [first, second] = store.homes(key);
+                lock(std::min(first, second));
+                if (second != first) {
+                    lock(std::max(first, second));
+                }
+                if (store.routing_epoch_.load(std::memory_order_acquire) == epoch) {
+                    index_ = first != second && store.shards_[first]->keyspace.count(key) > 0 ? first : second;
+                    break;
+                }
+                release();
+            }
+        }
+
+        ~ShardLock() {
+            // A write moves the version on before unlocking, which invalidates cached reads
+            if constexpr (std::is_same_v<Lock, std::unique_lock<std::shared_mutex>>) {
+                for (size_t i = 0; i < count_; i++) {
+                    store_.shards_[indexes_[i]]->version.fetch_add(1, std::memory_order_release);
+                }
+            }
+        }
+
+        size_t index() const { return index_; }
+
+    private:
+        void lock(size_t shard_index) {
+            indexes_[count_] = shard_index;
+            if (tx_held.store != &store_ || !tx_held.held[shard_index]) {
+                locks_[count_] = Lock(store_.shards_[shard_index]->mutex);
+            }
+            count_++;
+        }
+
+        void release() {
+            for (size_t i = 0; i < count_; i++) {
+                if (locks_[i].owns_lock()) {
+                    locks_[i].unlock();
+                }
+            }
+            count_ = 0;
+        }
+
+        const KVStore& store_;
+        size_t index_ = 0;
+        size_t indexes_[2];
+        size_t count_ = 0;
+        Lock locks_[2];
+    };
+
+    // Keeps keys from moving between shards during a whole-store scan. Inside atomically()
+    // the caller's shard locks already do that (and the reshard lock must not be taken after them).
+    class KVStore::ReshardPause {
+    public:
+        explicit ReshardPause(const KVStore& store) {
+            if (tx_held.store != &store) {
+                lock_ = std::shared_lock(store.reshard_mutex_);
+            }
+        }
+
+    private:
+        std::shared_lock<std::shared_mutex> lock_;
+    };
+
+    namespace {
+        // Per-thread copies of hot string values, valid while their shard's version is unchanged
+        struct HotCache {
+            struct Entry {
+                std::shared_ptr<const std::string> value;
+                size_t shard;
+                uint64_t version;
+            };
+            static constexpr size_t kMaxEntries = 64;
+
+            const KVStore* store = nullptr;
+            std::unordered_map<std::string, Entry> entries;
+        };
+        thread_local HotCache hot_cache;
+    }
+
+    KVStore::KVStore(size_t shards)
+        : shards_(std::max(shards, kMaxShards)), num_shards_(std::max<size_t>(shards, 1)), target_shards_(num_shards_.load()) {
+        for (size_t shard_index = 0; shard_index < num_shards_; shard_index++) {
+            shards_[shard_index] = std::make_unique<Shard>();
+        }
+    }
+
+    void KVStore::set_write_observer(WriteObserver observer) {
+        observer_ = std::move(observer);
+    }
+
+    void KVStore::enable_change_stream(size_t bytes_per_shard) {
+        ReshardPause pause(*this);
+        change_ring_bytes_ = bytes_per_shard;
+        for (size_t shard_index = 0; shard_index < shardsInUse(); shard_index++) {
+            shards_[shard_index]->changes = std::make_unique<ChangeRing>(bytes_per_shard);
+        }
+    }
+
+    void KVStore::emit(size_t shard_index, const Mutation& m) {
+        if (observer_) {
+            observer_(m);
+        }
+        if (auto& changes = shards_[shard_index]->changes) {
+            changes->append(change_seq_, m);
+        }
+    }
+
+    bool KVStore::read_changes(uint64_t from, size_t max, std::vector<ChangeEvent>& out, uint64_t& next) const {
+        from = std::max<uint64_t>(from, 1); // sequence numbers start at 1
+        next = from;
+        if (!change_stream_enabled() || max == 0) {
+            return change_stream_enabled();
+        }
+
+        // Shards left unused by a reshard keep their rings, so every ring is read
+        ReshardPause pause(*this);
+
+        // Everything numbered below `below` has been taken; wait for those appends to land
+        uint64_t below = change_seq_.load(std::memory_order_seq_cst);
+        for (const auto& shard : shards_) {
+            if (shard && shard->changes) {
+                shard->changes->wait_for_appends();
+            }
+        }
+
+        // Each shard's ring is already in order, and the first max overall are among
+        // the first max of each shard
+        size_t initial = out.size();
+        bool complete = true;
+        for (const auto& shard : shards_) {
+            if (shard && shard->changes) {
+                complete &= shard->changes->read(from, below, max, out);
+            }
+        }
+
+        std::sort(out.begin() + initial, out.end(), [](const ChangeEvent& a, const ChangeEvent& b) { return a.seq < b.seq; });
+        if (out.size() - initial >= max) {
+            out.resize(initial + max);
+            next = out.back().seq + 1;
+        } else {
+            next = std::max(from, below);
+        }
+        return complete;
+    }
+
+    void KVStore::purgeIfExpired(size_t shard_index, const std::string& key) {
+        auto& shard = *shards_[shard_index];
+        if (!isExpired(shard, key)) {
+            return;
+        }
+
+        eraseKey(shard, key);
+        emit(shard_index, Mutation::expire(key));
+    }
+
+    void KVStore::atomically(const std::vector<std::string>& keys, const std::function<void()>& fn) {
+        lock_shards_and_run([&] {
+            std::vector<size_t> indexes;
+            for (const auto& key : keys) {
+                auto [first, second] = homes(key);
+                indexes.push_back(first);
+                indexes.push_back(second);
+            }
+            return indexes;
+        }, fn);
+    }
+
+    void KVStore::atomically_all(const std::function<void()>& fn) {
+        lock_shards_and_run([&] {
+            std::vector<size_t> indexes(shardsInUse());
+            for (size_t i = 0; i < indexes.size(); i++) {
+                indexes[i] = i;
+            }
+            return indexes;
+        }, fn);
+    }
+
+    void KVStore::lock_shards_and_run(const std::function<std::vector<size_t>()>& list_indexes, const std::function<void()>& fn) {
+        if (tx_held.store == this) {
+            fn(); // nested: the outer call already holds what it needs
+            return;
+        }
+
+        std::vector<size_t> indexes;
+        std::vector<std::unique_lock<std::shared_mutex>> locks;
+        for (;;) {
+            uint64_t epoch = routing_epoch_.load(std::memory_order_acquire);
+            indexes = list_indexes();
+
+            // Ascending shard order, so two batches can never wait on each other in a cycle
+            std::sort(indexes.begin(), indexes.end());
+            indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+
+            locks.reserve(indexes.size());
+            for (size_t index : indexes) {
+                locks.emplace_back(shards_[index]->mutex);
+            }
+            if (routing_epoch_.load(std::memory_order_acquire) == epoch) {
+                break;
+            }
+            locks.clear(); // a reshard moved the keys' homes meanwhile
+        }
+
+        struct Scope {
+            Scope(const KVStore* store, size_t num_shards, const std::vector<size_t>& indexes) {
+                tx_held.store = store;
+                tx_held.held.assign(num_shards, false);
+                for (size_t index : indexes) {
+                    tx_held.held[index] = true;
+                }
+            }
+            ~Scope() { tx_held.store = nullptr; }
+        } scope(this, shards_.size(), indexes);
+
+        // Destroyed before the locks are released: fn may have changed any of these shards
+        struct BumpVersions {
+            const KVStore* store;
+            const std::vector<size_t>& indexes;
+            ~BumpVersions() {
+                for (size_t index : indexes) {
+                    store->shards_[index]->version.fetch_add(1, std::memory_order_release);
+                }
+            }
+        } bump{this, indexes};
+
+        fn();
+    }
+
+    std::pair<size_t, size_t> KVStore::homes(const std::string& key) const {
+        size_t hash = std::hash<std::string>{}(key);
+        // Acquire, so the shards a reshard added are visible along with the new count
+        size_t old_home = hash % num_shards_.load(std::memory_order_acquire);
+        size_t new_home = hash % target_shards_.load(std::memory_order_acquire);
+        if (old_home == new_home || shards_[old_home]->settled.load(std::memory_order_acquire)) {
+            return {new_home, new_home};
+        }
+        return {old_home, new_home};
+    }
 
     size_t KVStore::getShard(const std::string& key) const {
-        return std::hash<std::string>{}(key) % num_shards_;
+        // Keys are created in their new home, so a key is only in the old one until it moves
+        auto [old_home, new_home] = homes(key);
+        return shards_[old_home]->keyspace.count(key) > 0 ? old_home : new_home;
     }
 
     void KVStore::set(const std::string& key, const std::string& value) {
-        size_t shard_index = getShard(key);
-        auto& shard = shards_[shard_index];
-        std::unique_lock lock(shard.mutex);
-        shard.data[key] = value;
+        WriteLock lock(*this, key);
+        size_t shard_index = lock.index();
+        auto& shard = *shards_[shard_index];
+        purgeIfExpired(shard_index, key);
+        assignKey(shard, key, value); // replaces a value of any type
+        shard.expires.erase(key);
+
+        emit(shard_index, Mutation::set(key, value));
     }
 
     std::optional<std::string> KVStore::get(const std::string& key) const {
-        size_t shard_index = getShard(key);
-        const auto& shard = shards_[shard_index];
-        std::shared_lock lock(shard.mutex);
-        auto it = shard.data.find(key);
-        if (it != shard.data.end()) {
-            return it->second;
+        std::optional<std::string> result;
+        read_value(key, [&](std::string_view value, const std::shared_ptr<const std::string>&) { result.emplace(value); });
+        return result;
+    }
+
+    std::shared_ptr<const std::string> KVStore::get_shared(const std::string& key) const {
+        std::shared_ptr<const std::string> result;
+        read_value(key, [&](std::string_view value, const std::shared_ptr<const std::string>& shared) {
+            result = shared ? shared : std::make_shared<const std::string>(value);
+        });
+        return result;
+    }
+
+    bool KVStore::read_value(const std::string& key, const ValueReader& fn) const {
+        hot_keys_.record(key);
+
+        // Transactions skip the cache: their own writes only bump versions when they end
+        bool use_cache = hot_cache_ && tx_held.store != this;
+        if (use_cache) {
+            if (hot_cache.store != this) {
+                hot_cache.store = this;
+                hot_cache.entries.clear();
+            }
+            auto it = hot_cache.entries.find(key);
+            if (it != hot_cache.entries.end()) {
+                // Moving a key during a reshard bumps both shards' versions
+                auto [old_home, new_home] = homes(key);
+                const auto& entry = it->second;
+                if (old_home == new_home && entry.shard == new_home &&
+                    entry.version == shards_[new_home]->version.load(std::memory_order_acquire)) {
+                    fn(*entry.value, entry.value);
+                    return true;
+                }
+                hot_cache.entries.erase(it);
+            }
         }
-        return std::nullopt;
+
+        ReadLock lock(*this, key);
+        size_t shard_index = lock.index();
+        const auto& shard = *shards_[shard_index];
+        auto* value = findAs<StringValue>(shard, key);
+        if (value == nullptr) {
+            return false;
+        }
+
+        // Keys with a TTL stay uncached so they still disappear on time. Only a value about to
+        // be cached is copied into a buffer of its own.
+        if (use_cache && !shard.expires.count(key) && hot_keys_.is_hot(key)) {
+            auto shared = value->share();
+            if (hot_cache.entries.size() >= HotCache::kMaxEntries) {
+                hot_cache.entries.erase(hot_cache.entries.begin());
+            }
+            hot_cache.entries.insert_or_assign(key, HotCache::Entry{shared, shard_index, shard.version.load(std::memory_order_relaxed)});
+            fn(*shared, shared);
+        } else {
+            fn(value->view(), value->shared());
+        }
+        return true;
+    }
+
+    void KVStore::enable_hot_key_cache() {
+        hot_cache_ = true;
+    }
+
+    std::vector<std::pair<std::string, uint64_t>> KVStore::hot_keys(size_t count) const {
+        return hot_keys_.top(count);
+    }
+
+    void KVStore::enable_key_index() {
+        ReshardPause pause(*this);
+        for (size_t shard_index = 0; shard_index < shardsInUse(); shard_index++) {
+            auto& shard = *shards_[shard_index];
+            WriteLock lock(*this, shard_index);
+            shard.index = std::make_unique<KeyIndex>();
+            for (const auto& entry : shard.keyspace) {
+                shard.index->insert(entry.first);
+            }
+        }
+    }
+
+    std::vector<std::string> KVStore::scan_keys(const KeyRange& range, size_t limit) const {
+        if (!key_index_enabled() || limit == 0) {
+            return {};
+        }
+
+        // Start from whichever of min and prefix comes later
+        std::string_view from = range.min;
+        bool exclusive = range.min_exclusive;
+        if (range.prefix > range.min) {
+            from = range.prefix;
+            exclusive = false;
+        }
+
+        // False for the first key past the range, and so for every key after it
+        auto in_range = [&range](const std::string& key) {
+            if (key.compare(0, range.prefix.size(), range.prefix) != 0) {
+                return false;
+            }
+            if (range.max) {
+                int order = key.compare(*range.max);
+                return order < 0 || (order == 0 && !range.max_exclusive);
+            }
+            return true;
+        };
+
+        // Up to limit keys from each shard, each list already in order
+        ReshardPause pause(*this);
+        std::vector<std::vector<std::string>> found(shardsInUse());
+        for (size_t shard_index = 0; shard_index < found.size(); shard_index++) {
+            const auto& shard = *shards_[shard_index];
+            ReadLock lock(*this, shard_index);
+            auto& keys = found[shard_index];
+            for (auto cursor = shard.index->seek(from, exclusive); cursor.valid() && keys.size() < limit && in_range(cursor.key()); cursor.next()) {
+                if (!isExpired(shard, cursor.key())) {
+                    keys.push_back(cursor.key());
+                }
+            }
+        }
+
+        // k-way merge: the heap holds each shard's next key as (shard, position)
+        using Head = std::pair<size_t, size_t>;
+        auto after = [&found](const Head& a, const Head& b) { return found[a.first][a.second] > found[b.first][b.second]; };
+        std::priority_queue<Head, std::vector<Head>, decltype(after)> heap(after);
+        for (size_t shard_index = 0; shard_index < found.size(); shard_index++) {
+            if (!found[shard_index].empty()) {
+                heap.emplace(shard_index, 0);
+            }
+        }
+
+        std::vector<std::string> keys;
+        while (!heap.empty() && keys.size() < limit) {
+            auto [shard_index, pos] = heap.top();
+            heap.pop();
+            keys.push_back(std::move(found[shard_index][pos]));
+            if (pos + 1 < found[shard_index].size()) {
+                heap.emplace(shard_index, pos + 1);
+            }
+        }
+        return keys;
     }
 
     bool KVStore::del(const std::string& key) {
-        size_t shard_index = getShard(key);
-        auto& shard = shards_[shard_index];
-        std::unique_lock lock(shard.mutex);
-        return shard.data.erase(key) > 0;
+        WriteLock lock(*this, key);
+        size_t shard_index = lock.index();
+        auto& shard = *shards_[shard_index];
+        purgeIfExpired(shard_index, key);
+        bool erased = eraseKey(shard, key);
+
+        if (erased) {
+
+            emit(shard_index, Mutation::del(key));
+
+        }
+        return erased;
     }
 
     bool KVStore::exists(const std::string& key) const {
-        size_t shard_index = getShard(key);
-        const auto& shard = shards_[shard_index];
-        std::shared_lock lock(shard.mutex);
-        return shard.data.find(key) != shard.data.end();
+        ReadLock lock(*this, key);
+        size_t shard_index = lock.index();
+        const auto& shard = *shards_[shard_index];
+        return shard.keyspace.find(key) != shard.keyspace.end() && !isExpired(shard, key);
+    }
+
+    std::string KVStore::type(const std::string& key) const {
+        ReadLock lock(*this, key);
+        size_t shard_index = lock.index();
+        const auto& shard = *shards_[shard_index];
+        auto it = shard.keyspace.find(key);
+        if (it == shard.keyspace.end() || isExpired(shard, key)) {
+            return "none";
+        }
+
+        static const char* names[] = {"string", "zset", "hash", "hyperloglog", "bloom"};
+        return names[it->second.index()];
     }
 
     bool KVStore::zadd(const std::string& key, const std::string& member, double score) {
-        size_t shard_index = getShard(key);
-        auto& shard = shards_[shard_index];
-        std::unique_lock lock(shard.mutex);
-        return shard.sorted_sets[key].add(member, score);
+        WriteLock lock(*this, key);
+        size_t shard_index = lock.index();
+        auto& shard = *shards_[shard_index];
+        purgeIfExpired(shard_index, key);
+        bool changed = findOrCreate<ZSet>(shard, key).add(member, score);
+
+        if (changed) {
+
+            emit(shard_index, Mutation::zadd(key, member, score));
+
+        }
+        return changed;
+    }
+
+    size_t KVStore::zadd(const std::string& key, std::vector<std::pair<std::string, double>> members,
+                         const ZAddOptions& options) {
+        WriteLock lock(*this, key);
+        size_t shard_index = lock.index();
+        auto& shard = *shards_[shard_index];
+        purgeIfExpired(shard_index, key);
+        if (members.empty()) {
+            return 0;
+        }
+
+        auto* existing = findAs<ZSet>(shard, key);
+        if (existing == nullptr && options.xx) {
+            return 0;
+        }
+
+        // Conditions depend on earlier pairs for the same member, so only a plain ZADD can bulk-build
+        if (existing != nullptr || !options.unconditional()) {
+            ZSet& zset = existing != nullptr ? *existing : findOrCreate<ZSet>(shard, key);
+
+            size_t counted = 0;
+            for (const auto& [member, score] : members) {
+                auto result = zset.add(member, score, options);
+                if (result == ZSet::ZAddResult::Unchanged) {
+                    continue;
+                }
+                if (result == ZSet::ZAddResult::Added || options.ch) {
+                    counted++;
+                }
+                emit(shard_index, Mutation::zadd(key, member, score));
+            }
+            return counted;
+        }
+
+        ZSet zset;
+        zset.build(std::move(members));
+        zset.for_each([&](const std::string& member, double score) {
+            emit(shard_index, Mutation::zadd(key, member, score));
+        });
+
+        size_t added = zset.size();
+        assignKey(shard, key, std::move(zset));
+        return added;
     }
 
     bool KVStore::zrem(const std::string& key, const std::string& member) {
-        size_t shard_index = getShard(key);
-        auto& shard = shards_[shard_index];
-        std::unique_lock lock(shard.mutex);
-        return shard.sorted_sets[key].remove(member);
+        WriteLock lock(*this, key);
+        size_t shard_index = lock.index();
+        auto& shard = *shards_[shard_index];
+        purgeIfExpired(shard_index, key);
+        auto* zset = findAs<ZSet>(shard, key);
+        if (zset == nullptr || !zset->remove(member)) {
+            return false;
+        }
+
+        if (zset->size() == 0) {
+            eraseKey(shard, key);
+        }
+
+        emit(shard_index, Mutation::zrem(key, member));
+        return true;
     }
 
     std::optional<double> KVStore::zscore(const std::string& key, const std::string& member) const {
-        size_t shard_index = getShard(key);
-        const auto& shard = shards_[shard_index];
-        std::shared_lock lock(shard.mutex);
-        auto it = shard.sorted_sets.find(key);
-        if (it != shard.sorted_sets.end()) {
-            return it->second.score(member);
+        hot_keys_.record(key);
+        ReadLock lock(*this, key);
+        size_t shard_index = lock.index();
+        const auto& shard = *shards_[shard_index];
+        if (auto* zset = findAs<ZSet>(shard, key)) {
+            return zset->score(member);
         }
         return std::nullopt;
     }
@@ -68,63 +613,616 @@ namespace kv {
     //Now zrank, zrange, and zsize
 
     size_t KVStore::zsize(const std::string& key) const {
-        size_t shard_index = getShard(key);
-        const auto& shard = shards_[shard_index];
-        std::shared_lock lock(shard.mutex);
-        auto it = shard.sorted_sets.find(key);
-        if (it != shard.sorted_sets.end()) {
-            return it->second.size();
+        ReadLock lock(*this, key);
+        size_t shard_index = lock.index();
+        const auto& shard = *shards_[shard_index];
+        if (auto* zset = findAs<ZSet>(shard, key)) {
+            return zset->size();
         }
         return 0;
     }
 
     std::vector<std::pair<std::string, double>> KVStore::zrange(const std::string& key, int start, int stop) const {
-        size_t shard_index = getShard(key);
-        const auto& shard = shards_[shard_index];
-        std::shared_lock lock(shard.mutex);
-
-        auto it = shard.sorted_sets.find(key);
-        if (it != shard.sorted_sets.end()) {
-            return it->second.range(start, stop); 
+        hot_keys_.record(key);
+        ReadLock lock(*this, key);
+        size_t shard_index = lock.index();
+        const auto& shard = *shards_[shard_index];
+        if (auto* zset = findAs<ZSet>(shard, key)) {
+            return zset->range(start, stop);
         }
         return {};
-
     }
 
     std::optional<int> KVStore::zrank(const std::string& key, const std::string& member) const {
-        size_t shard_index = getShard(key);
-        const auto& shard = shards_[shard_index];
-        std::shared_lock lock(shard.mutex);
-        auto it = shard.sorted_sets.find(key);
-        if (it != shard.sorted_sets.end()) {
-            return it->second.rank(member);
+        ReadLock lock(*this, key);
+        size_t shard_index = lock.index();
+        const auto& shard = *shards_[shard_index];
+        if (auto* zset = findAs<ZSet>(shard, key)) {
+            return zset->rank(member);
         }
         return std::nullopt;
     }
 
+    std::vector<std::pair<std::string, double>> KVStore::zpopmin(const std::string& key, size_t count) {
+        return zpop(key, count, false);
+    }
+
+    std::vector<std::pair<std::string, double>> KVStore::zpopmax(const std::string& key, size_t count) {
+        return zpop(key, count, true);
+    }
+
+    std::vector<std::pair<std::string, double>> KVStore::zpop(const std::string& key, size_t count, bool max) {
+        WriteLock lock(*this, key);
+        size_t shard_index = lock.index();
+        auto& shard = *shards_[shard_index];
+        purgeIfExpired(shard_index, key);
+        auto* zset = findAs<ZSet>(shard, key);
+        if (zset == nullptr) {
+            return {};
+        }
+
+        auto popped = max ? zset->pop_max(count) : zset->pop_min(count);
+        for (const auto& [member, score] : popped) {
+            emit(shard_index, Mutation::zrem(key, member));
+        }
+
+        if (zset->size() == 0) {
+            eraseKey(shard, key);
+        }
+        return popped;
+    }
+
+    size_t KVStore::zunionstore(const std::string& dest, const std::vector<std::string>& keys, const std::vector<double>& weights, Aggregate aggregate) {
+        return zstore(dest, keys, [&](const std::vector<const ZSet*>& sets) { return zunion(sets, weights, aggregate); });
+    }
+
+    size_t KVStore::zinterstore(const std::string& dest, const std::vector<std::string>& keys, const std::vector<double>& weights, Aggregate aggregate) {
+        return zstore(dest, keys, [&](const std::vector<const ZSet*>& sets) { return zinter(sets, weights, aggregate); });
+    }
+
+    size_t KVStore::zstore(const std::string& dest, const std::vector<std::string>& keys, const std::function<ZSet(const std::vector<const ZSet*>&)>& combine) {
+        std::vector<std::string> locked = keys;
+        locked.push_back(dest);
+        size_t stored = 0;
+
+        atomically(locked, [&] {
+            std::vector<const ZSet*> sets;
+            for (const auto& key : keys) {
+                size_t shard_index = getShard(key);
+                purgeIfExpired(shard_index, key);
+                sets.push_back(findAs<ZSet>(*shards_[shard_index], key));
+            }
+
+            // Built before touching dest, which may also be a source
+            ZSet result = combine(sets);
+
+            size_t shard_index = getShard(dest);
+            auto& shard = *shards_[shard_index];
+            purgeIfExpired(shard_index, dest);
+            if (eraseKey(shard, dest)) {
+                emit(shard_index, Mutation::del(dest));
+            }
+
+            stored = result.size();
+            if (stored > 0) {
+                result.for_each([&](const std::string& member, double score) {
+                    emit(shard_index, Mutation::zadd(dest, member, score));
+                });
+                assignKey(shard, dest, std::move(result));
+            }
+        });
+
+        return stored;
+    }
+
+    size_t KVStore::hset(const std::string& key, const std::vector<std::pair<std::string, std::string>>& fields) {
+        WriteLock lock(*this, key);
+        size_t shard_index = lock.index();
+        auto& shard = *shards_[shard_index];
+        purgeIfExpired(shard_index, key);
+        if (fields.empty()) {
+            return 0;
+        }
+        auto& hash = findOrCreate<Hash>(shard, key);
+
+        size_t added = 0;
+        for (const auto& [field, value] : fields) {
+            added += hash.set(field, value);
+
+            emit(shard_index, Mutation::hset(key, field, value));
+        }
+        return added;
+    }
+
+    std::optional<std::string> KVStore::hget(const std::string& key, const std::string& field) const {
+        hot_keys_.record(key);
+        ReadLock lock(*this, key);
+        size_t shard_index = lock.index();
+        const auto& shard = *shards_[shard_index];
+        if (auto* hash = findAs<Hash>(shard, key)) {
+            return hash->get(field);
+        }
+        return std::nullopt;
+    }
+
+    std::vector<std::optional<std::string>> KVStore::hmget(const std::string& key, const std::vector<std::string>& fields) const {
+        hot_keys_.record(key);
+        ReadLock lock(*this, key);
+        size_t shard_index = lock.index();
+        const auto& shard = *shards_[shard_index];
+
+        std::vector<std::optional<std::string>> values(fields.size());
+        if (auto* hash = findAs<Hash>(shard, key)) {
+            for (size_t i = 0; i < fields.size(); i++) {
+                values[i] = hash->get(fields[i]);
+            }
+        }
+        return values;
+    }
+
+    size_t KVStore::hdel(const std::string& key, const std::vector<std::string>& fields) {
+        WriteLock lock(*this, key);
+        size_t shard_index = lock.index();
+        auto& shard = *shards_[shard_index];
+        purgeIfExpired(shard_index, key);
+        auto* hash = findAs<Hash>(shard, key);
+        if (hash == nullptr) {
+            return 0;
+        }
+
+        size_t removed = 0;
+        for (const auto& field : fields) {
+            if (hash->remove(field)) {
+                removed++;
+
+                emit(shard_index, Mutation::hdel(key, field));
+            }
+        }
+
+        if (hash->empty()) {
+            eraseKey(shard, key);
+        }
+        return removed;
+    }
+
+    size_t KVStore::hlen(const std::string& key) const {
+        ReadLock lock(*this, key);
+        size_t shard_index = lock.index();
+        const auto& shard = *shards_[shard_index];
+        if (auto* hash = findAs<Hash>(shard, key)) {
+            return hash->size();
+        }
+        return 0;
+    }
+
+    std::vector<std::pair<std::string, std::string>> KVStore::hgetall(const std::string& key) const {
+        hot_keys_.record(key);
+        ReadLock lock(*this, key);
+        size_t shard_index = lock.index();
+        const auto& shard = *shards_[shard_index];
+        if (auto* hash = findAs<Hash>(shard, key)) {
+            return hash->all();
+        }
+        return {};
+    }
+
+    std::optional<long long> KVStore::hincrby(const std::string& key, const std::string& field, long long delta) {
+        WriteLock lock(*this, key);
+        size_t shard_index = lock.index();
+        auto& shard = *shards_[shard_index];
+        purgeIfExpired(shard_index, key);
+
+        long long current = 0;
+        auto* existing = findAs<Hash>(shard, key);
+        auto value = existing ? existing->get(field) : std::nullopt;
+        if (value) {
+            size_t used = 0;
+            try {
+                current = std::stoll(*value, &used);
+            } catch (const std::exception&) {
+                return std::nullopt;
+            }
+            if (used != value->size()) {
+                return std::nullopt;
+            }
+        }
+
+        long long result;
+        if (__builtin_add_overflow(current, delta, &result)) {
+            return std::nullopt;
+        }
+
+        // Logged as the resulting HSET so replaying it twice is harmless
+        std::string encoded = std::to_string(result);
+        findOrCreate<Hash>(shard, key).set(field, encoded);
+        emit(shard_index, Mutation::hset(key, field, encoded));
+        return result;
+    }
+
     std::vector<std::pair<std::string, std::string>> KVStore::all_entries() const {
         std::vector<std::pair<std::string, std::string>> entries;
 
-        for (const auto& shard : shards_) {
-            std::shared_lock lock(shard.mutex);
-            
-            // String key-value pairs
-            for (const auto& [key, value] : shard.data) {
-                entries.emplace_back("STRING:" + key, value);
+        snapshot([&entries](const Mutation& m) {
+            std::string key(m.key);
+
+            switch (m.type) {
+            case Mutation::Type::Set:
+                entries.emplace_back("STRING:" + key, std::string(m.value));
+                break;
+            case Mutation::Type::ZAdd:
+                entries.emplace_back("ZSET:" + key + ":" + std::string(m.value), std::to_string(m.score));
+                break;
+            case Mutation::Type::HSet:
+                entries.emplace_back("HASH:" + key + ":" + std::string(m.field), std::string(m.value));
+                break;
+            default:
+                break;
             }
-            
-            // Sorted set entries
-            for (const auto& [key, zset] : shard.sorted_sets) {
-                auto members = zset.all(); // Get all members
-                for (const auto& [member, score] : members) {
-                    entries.emplace_back("ZSET:" + key + ":" + member, std::to_string(score));
+        });
+
+        return entries;
+    }
+
+    bool KVStore::pfadd(const std::string& key, const std::vector<std::string>& elements) {
+        WriteLock lock(*this, key);
+        size_t shard_index = lock.index();
+        auto& shard = *shards_[shard_index];
+        purgeIfExpired(shard_index, key);
+
+        bool created = findAs<HyperLogLog>(shard, key) == nullptr;
+        auto& hll = findOrCreate<HyperLogLog>(shard, key);
+
+        bool changed = false;
+        for (const auto& element : elements) {
+            if (hll.add(element)) {
+                changed = true;
+                emit(shard_index, Mutation::pfadd(key, element));
+            }
+        }
+
+        // PFADD with no elements still creates the key
+        if (created && !changed) {
+            std::string bytes = hll.serialize();
+            emit(shard_index, Mutation::restore(key, bytes));
+        }
+        return created || changed;
+    }
+
+    uint64_t KVStore::pfcount(const std::vector<std::string>& keys) const {
+        HyperLogLog merged;
+
+        for (const auto& key : keys) {
+            ReadLock lock(*this, key);
+            size_t shard_index = lock.index();
+            if (auto* hll = findAs<HyperLogLog>(*shards_[shard_index], key)) {
+                if (keys.size() == 1) {
+                    return hll->count();
                 }
+                merged.merge(*hll);
             }
         }
+        return merged.count();
+    }
 
-        return entries;
+    void KVStore::pfmerge(const std::string& dest, const std::vector<std::string>& sources) {
+        std::vector<std::string> locked = sources;
+        locked.push_back(dest);
+
+        atomically(locked, [&] {
+            // Every type is checked before dest changes
+            HyperLogLog result;
+            for (const auto& key : locked) {
+                size_t shard_index = getShard(key);
+                purgeIfExpired(shard_index, key);
+                if (auto* hll = findAs<HyperLogLog>(*shards_[shard_index], key)) {
+                    result.merge(*hll);
+                }
+            }
+
+            size_t shard_index = getShard(dest);
+            std::string bytes = result.serialize();
+            assignKey(*shards_[shard_index], dest, std::move(result));
+            emit(shard_index, Mutation::restore(dest, bytes));
+        });
+    }
+
+    bool KVStore::bfreserve(const std::string& key, double error_rate, size_t capacity) {
+        WriteLock lock(*this, key);
+        size_t shard_index = lock.index();
+        auto& shard = *shards_[shard_index];
+        purgeIfExpired(shard_index, key);
+
+        if (shard.keyspace.count(key) > 0) {
+            return false;
+        }
+
+        BloomFilter filter(capacity, error_rate);
+        std::string bytes = filter.serialize();
+        assignKey(shard, key, std::move(filter));
+        emit(shard_index, Mutation::restore(key, bytes));
+        return true;
+    }
+
+    std::vector<bool> KVStore::bfadd(const std::string& key, const std::vector<std::string>& items) {
+        WriteLock lock(*this, key);
+        size_t shard_index = lock.index();
+        auto& shard = *shards_[shard_index];
+        purgeIfExpired(shard_index, key);
+
+        std::vector<bool> added;
+        if (items.empty()) {
+            return added;
+        }
+
+        auto& filter = findOrCreate<BloomFilter>(shard, key);
+        added.reserve(items.size());
+        for (const auto& item : items) {
+            added.push_back(filter.add(item));
+            if (added.back()) {
+                emit(shard_index, Mutation::bfadd(key, item));
+            }
+        }
+        return added;
+    }
+
+    std::vector<bool> KVStore::bfexists(const std::string& key, const std::vector<std::string>& items) const {
+        ReadLock lock(*this, key);
+        size_t shard_index = lock.index();
+
+        std::vector<bool> found(items.size(), false);
+        if (auto* filter = findAs<BloomFilter>(*shards_[shard_index], key)) {
+            for (size_t i = 0; i < items.size(); i++) {
+                found[i] = filter->contains(items[i]);
+            }
+        }
+        return found;
+    }
+
+    bool KVStore::restore(const std::string& key, std::string_view bytes) {
+        // The leading tag byte tells the types apart
+        Value value;
+        if (auto hll = HyperLogLog::deserialize(bytes)) {
+            value = std::move(*hll);
+        } else if (auto filter = BloomFilter::deserialize(bytes)) {
+            value = std::move(*filter);
+        } else {
+            return false;
+        }
+
+        WriteLock lock(*this, key);
+        size_t shard_index = lock.index();
+        auto& shard = *shards_[shard_index];
+        assignKey(shard, key, std::move(value));
+        shard.expires.erase(key);
+        emit(shard_index, Mutation::restore(key, bytes));
+        return true;
+    }
+
+    void KVStore::snapshot(const std::function<void(const Mutation &)> &fn) const {
+        // Paused so no key is visited twice, or missed, on its way between shards
+        ReshardPause pause(*this);
+        for (size_t shard_index = 0; shard_index < shardsInUse(); shard_index++) {
+            const auto& shard = *shards_[shard_index];
+            ReadLock lock(*this, shard_index);
+
+            auto now = Clock::now();
+
+            for (const auto& [key, value] : shard.keyspace) {
+                std::chrono::seconds ttl{0};
+                if (auto it = shard.expires.find(key); it != shard.expires.end()) {
+                    if (it->second <= now) {
+                        continue;
+                    }
+                    // Rounded up so a replayed snapshot never expires a key early
+                    ttl = std::chrono::ceil<std::chrono::seconds>(it->second - now);
+                }
+
+                if (auto* str = std::get_if<StringValue>(&value)) {
+                    fn(Mutation::set(key, str->view(), ttl));
+                } else if (auto* zset = std::get_if<ZSet>(&value)) {
+                    for (const auto& [member, score] : zset->all()) {
+                        fn(Mutation::zadd(key, member, score));
+                    }
+                } else if (auto* hash = std::get_if<Hash>(&value)) {
+                    for (const auto& [field, value] : hash->all()) {
+                        fn(Mutation::hset(key, field, value));
+                    }
+                } else if (auto* hll = std::get_if<HyperLogLog>(&value)) {
+                    std::string bytes = hll->serialize();
+                    fn(Mutation::restore(key, bytes));
+                } else if (auto* filter = std::get_if<BloomFilter>(&value)) {
+                    std::string bytes = filter->serialize();
+                    fn(Mutation::restore(key, bytes));
+                }
+            }
+        }
+    }
+
+    void KVStore::clear() {
+        ReshardPause pause(*this);
+        for (size_t shard_index = 0; shard_index < shardsInUse(); shard_index++) {
+            auto& shard = *shards_[shard_index];
+            WriteLock lock(*this, shard_index);
+            shard.keyspace.clear();
+            shard.expires.clear();
+            if (shard.index) {
+                shard.index->clear();
+            }
+        }
+    }
+
+    void KVStore::setWithTTL(const std::string& key, const std::string& value, std::chrono::seconds ttl) {
+        WriteLock lock(*this, key);
+        size_t shard_index = lock.index();
+        auto& shard = *shards_[shard_index];
+        assignKey(shard, key, value);
+        shard.expires.insert_or_assign(key, Clock::now() + ttl);
+
+        emit(shard_index, Mutation::set(key, value, ttl));
+    }
+
+    long long KVStore::ttl(const std::string& key) const {
+        ReadLock lock(*this, key);
+        size_t shard_index = lock.index();
+        const auto& shard = *shards_[shard_index];
+        if (shard.keyspace.find(key) == shard.keyspace.end() || isExpired(shard, key)) {
+            return -2;
+        }
+
+        auto it = shard.expires.find(key);
+        if (it == shard.expires.end()) {
+            return -1;
+        }
+        return std::chrono::ceil<std::chrono::seconds>(it->second - Clock::now()).count();
+    }
+
+    size_t KVStore::expire_due() {
+        size_t expired = 0;
+
+        // A key moved past the loop mid-reshard is left for the next call
+        for (size_t shard_index = 0; shard_index < shardsInUse(); shard_index++) {
+            auto& shard = *shards_[shard_index];
+            WriteLock lock(*this, shard_index);
+            if (shard.expires.empty()) {
+                continue;
+            }
+
+            auto now = Clock::now();
+            for (auto it = shard.expires.begin(); it != shard.expires.end();) {
+                if (it->second > now) {
+                    ++it;
+                    continue;
+                }
+
+                std::string key = it->first;
+                it = shard.expires.erase(it);
+                eraseKey(shard, key);
+                emit(shard_index, Mutation::expire(key));
+                expired++;
+            }
+        }
+
+        return expired;
     }
 
-    
+    void KVStore::prepareShards(size_t from, size_t to) {
+        for (size_t shard_index = from; shard_index < to; shard_index++) {
+            if (!shards_[shard_index]) {
+                shards_[shard_index] = std::make_unique<Shard>();
+            }
+            auto& shard = *shards_[shard_index];
+            if (change_ring_bytes_ > 0 && !shard.changes) {
+                shard.changes = std::make_unique<ChangeRing>(change_ring_bytes_);
+            }
+            if (key_index_enabled() && !shard.index) {
+                shard.index = std::make_unique<KeyIndex>();
+            }
+        }
+    }
+
+    bool KVStore::reshard(size_t shards) {
+        std::unique_lock<std::shared_mutex> guard(reshard_mutex_);
+        size_t from = num_shards_.load();
+        if (from != target_shards_.load() || shards == 0 || shards > shards_.size() || shards == from) {
+            return false;
+        }
+
+        // Shards added by growing are created under these locks, before anything routes to them
+        lock_shards_and_run([&] {
+            std::vector<size_t> indexes(from);
+            for (size_t i = 0; i < indexes.size(); i++) {
+                indexes[i] = i;
+            }
+            return indexes;
+        }, [&] {
+            prepareShards(from, shards);
+            for (size_t shard_index = 0; shard_index < from; shard_index++) {
+                shards_[shard_index]->settled.store(false, std::memory_order_release);
+            }
+            target_shards_.store(shards);
+            routing_epoch_.fetch_add(1, std::memory_order_release);
+        });
+
+        reshard_ = Reshard{};
+        reshard_sources_done_.store(0);
+        reshard_moved_.store(0);
+        return true;
+    }
+
+    bool KVStore::reshard_step(size_t max_keys) {
+        std::unique_lock<std::shared_mutex> guard(reshard_mutex_);
+        size_t from = num_shards_.load();
+        size_t to = target_shards_.load();
+        if (from == to) {
+            return false;
+        }
+
+        for (size_t moved = 0; moved < max_keys;) {
+            if (reshard_.next == reshard_.pending.size()) {
+                if (reshard_.listed) {
+                    // Drained: keys hashing to the source now only look in their new home
+                    WriteLock lock(*this, reshard_.source);
+                    shards_[reshard_.source]->settled.store(true, std::memory_order_release);
+                    routing_epoch_.fetch_add(1, std::memory_order_release);
+                    reshard_sources_done_.fetch_add(1);
+                    size_t next_source = reshard_.source + 1;
+                    reshard_ = Reshard{};
+                    reshard_.source = next_source;
+                }
+
+                if (reshard_.source == from) {
+                    atomically_all([&] {
+                        num_shards_.store(to);
+                        routing_epoch_.fetch_add(1, std::memory_order_release);
+                    });
+                    return false;
+                }
+
+                // Keys created from here on go to their new home, so the list stays complete
+                ReadLock lock(*this, reshard_.source);
+                for (const auto& entry : shards_[reshard_.source]->keyspace) {
+                    if (std::hash<std::string>{}(entry.first) % to != reshard_.source) {
+                        reshard_.pending.push_back(entry.first);
+                    }
+                }
+                reshard_.listed = true;
+                continue;
+            }
+
+            const std::string& key = reshard_.pending[reshard_.next++];
+            size_t source = reshard_.source;
+            size_t dest = std::hash<std::string>{}(key) % to;
+            WriteLock first(*this, std::min(source, dest));
+            WriteLock second(*this, std::max(source, dest));
+
+            auto& src = *shards_[source];
+            auto& dst = *shards_[dest];
+            auto node = src.keyspace.extract(key);
+            if (node.empty()) {
+                continue; // deleted since it was listed
+            }
+            if (auto it = src.expires.find(key); it != src.expires.end()) {
+                dst.expires.insert_or_assign(key, it->second);
+                src.expires.erase(it);
+            }
+            if (src.index) {
+                src.index->erase(key);
+                dst.index->insert(key);
+            }
+            dst.keyspace.insert(std::move(node));
+            reshard_moved_.fetch_add(1);
+            moved++;
+        }
+        return true;
+    }
+
+    ReshardStatus KVStore::reshard_status() const {
+        ReshardStatus status;
+        status.shards = num_shards_.load();
+        status.target = target_shards_.load();
+        status.sources_done = reshard_sources_done_.load();
+        status.keys_moved = reshard_moved_.load();
+        return status;
+    }
 
-}
\ No newline at end of file
+}
@@ -1,61 +1,274 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <optional>
 #include <unordered_map>
+#include <variant>
+#include <stdexcept>
+#include <mutex>
 #include <shared_mutex>
 #include <vector>
 #include <chrono>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <algorithm>
 #include "zset.h"
+#include "zset_algebra.h"
+#include "hash.h"
+#include "hyperloglog.h"
+#include "bloom_filter.h"
+#include "mutation.h"
+#include "change_ring.h"
+#include "hot_keys.h"
+#include "string_value.h"
+#include "key_index.h"
 
 
 
 namespace kv
 {
+    // Thrown when a command is applied to a key holding a different type
+    struct WrongTypeError : std::runtime_error
+    {
+        WrongTypeError() : std::runtime_error("WRONGTYPE Operation against a key holding the wrong kind of value") {}
+    };
+
+    // Lexicographic range of key names for KVStore::scan_keys
+    struct KeyRange
+    {
+        std::string min;                // from the first key, or from min
+        bool min_exclusive = false;     // ...or strictly after it
+        std::optional<std::string> max; // up to the last key, or up to max
+        bool max_exclusive = false;
+        std::string prefix;             // only keys starting with prefix
+    };
+
+    // Progress of an online shard count change, see KVStore::reshard
+    struct ReshardStatus
+    {
+        size_t shards = 0;        // shards keys are hashed over (the old count while resharding)
+        size_t target = 0;        // equal to shards unless resharding
+        size_t sources_done = 0;  // old shards fully drained, out of `shards`
+        uint64_t keys_moved = 0;  // by the current or last reshard
+        bool in_progress() const { return shards != target; }
+    };
+
     class KVStore
     {
     public:
+        using WriteObserver = std::function<void(const Mutation &)>;
+
+        // The shard count can later change online with reshard, up to max(shards, kMaxShards)
+        static constexpr size_t kMaxShards = 1024;
+
         KVStore(size_t shards = 16);
 
+        // Called under the shard's write lock after every mutation that changed something,
+        // so observers see writes to a key in the order they were applied.
+        // Set before the store is shared between threads.
+        void set_write_observer(WriteObserver observer);
+
+        // Opt-in change data capture: from now on every mutation (expirations included) is
+        // appended to a ring of bytes_per_shard in its shard, tagged with a global sequence number.
+        // Call before the store is shared between threads.
+        void enable_change_stream(size_t bytes_per_shard = 1 << 20);
+        bool change_stream_enabled() const { return shards_[0]->changes != nullptr; }
+
+        // Events with seq >= from from every shard, merged in sequence order, at most max.
+        // next is where the following read should start. Returns false if events from `from`
+        // onwards have already been overwritten (the reader has to resync) or the stream is disabled.
+        bool read_changes(uint64_t from, size_t max, std::vector<ChangeEvent> &out, uint64_t &next) const;
+
+        // Runs fn while holding the write locks of every shard owning one of keys, so a
+        // batch of calls made by fn on this thread is applied in one critical section.
+        // Locks are taken in shard order. fn must only touch those keys.
+        void atomically(const std::vector<std::string> &keys, const std::function<void()> &fn);
+        void atomically_all(const std::function<void()> &fn);
+
+        // Reports the current contents as Set/ZAdd/HSet mutations, one shard at a time under its read lock
+        void snapshot(const std::function<void(const Mutation &)> &fn) const;
+        void clear();
+
         //Regular operations
 
         void set(const std::string &key, const std::string &value);
         std::optional<std::string> get(const std::string &key) const;
+        // Calls fn with the value in place, under the shard lock or from this thread's hot
+        // cache. shared is the buffer holding it when there is one (values of
+        // StringValue::kSharedFrom bytes or more, and cached ones), so fn can keep a reference
+        // instead of copying; it is null for small stored values. False if the key is missing.
+        using ValueReader = std::function<void(std::string_view value, const std::shared_ptr<const std::string> &shared)>;
+        bool read_value(const std::string &key, const ValueReader &fn) const;
+        // Like get, but large values come back as the stored immutable buffer instead of a
+        // copy. Null if the key is missing.
+        std::shared_ptr<const std::string> get_shared(const std::string &key) const;
         bool del(const std::string &key);
         bool exists(const std::string &key) const;
+        // "string", "zset", "hash", "hyperloglog", "bloom" or "none"
+        std::string type(const std::string &key) const;
         std::vector<std::pair<std::string, std::string>> all_entries() const;
 
+        // Most read keys by sampled estimate (GET, HGET, HMGET, HGETALL, ZSCORE, ZRANGE), hottest first
+        std::vector<std::pair<std::string, uint64_t>> hot_keys(size_t count) const;
+
+        // Opt-in: GETs of keys currently among the hot keys are served from a per-thread copy,
+        // without the shard lock, until a write to their shard. Keys with a TTL are never cached.
+        // Call before the store is shared between threads.
+        void enable_hot_key_cache();
+
+        // Opt-in ordered index of key names (a B+tree per shard) for range scans, built from
+        // the keys already stored. Call before the store is shared between threads.
+        void enable_key_index();
+        bool key_index_enabled() const { return shards_[0]->index != nullptr; }
+
+        // Keys of any type in range, in order, at most limit. Each shard's index is read from
+        // the start of the range, and the shards' results are merged with a heap, so the cost
+        // grows with the number of shards and matches rather than the number of keys.
+        // Empty if the index is disabled.
+        std::vector<std::string> scan_keys(const KeyRange &range, size_t limit) const;
+
         //Sorted set operations
 
         bool zadd(const std::string &key, const std::string &member, double score);
+        // Many (member, score) pairs under one lock, applied in order under options' conditions.
+        // Without conditions a new key is bulk-built with ZSet::build. Returns how many members
+        // were added, plus how many changed score with options.ch.
+        size_t zadd(const std::string &key, std::vector<std::pair<std::string, double>> members,
+                    const ZAddOptions &options = {});
         std::optional<double> zscore(const std::string &key, const std::string &member) const;
         std::optional<int> zrank(const std::string &key, const std::string &member) const;
         std::vector<std::pair<std::string, double>> zrange(const std::string &key, int start, int stop) const;
         bool zrem(const std::string &key, const std::string &member);
         size_t zsize(const std::string &key) const;
+        // Removes and returns up to count lowest (or highest) scored members, logged as ZREMs
+        std::vector<std::pair<std::string, double>> zpopmin(const std::string &key, size_t count);
+        std::vector<std::pair<std::string, double>> zpopmax(const std::string &key, size_t count);
+        // Replace dest with the union/intersection of keys (one weight per key) and return its size.
+        // Runs under the write locks of every shard involved; logged as DEL dest plus its ZADDs.
+        size_t zunionstore(const std::string &dest, const std::vector<std::string> &keys, const std::vector<double> &weights, Aggregate aggregate);
+        size_t zinterstore(const std::string &dest, const std::vector<std::string> &keys, const std::vector<double> &weights, Aggregate aggregate);
+
+        //Hash operations
 
-        
+        // Returns the number of fields that were new
+        size_t hset(const std::string &key, const std::vector<std::pair<std::string, std::string>> &fields);
+        std::optional<std::string> hget(const std::string &key, const std::string &field) const;
+        std::vector<std::optional<std::string>> hmget(const std::string &key, const std::vector<std::string> &fields) const;
+        size_t hdel(const std::string &key, const std::vector<std::string> &fields);
+        size_t hlen(const std::string &key) const;
+        std::vector<std::pair<std::string, std::string>> hgetall(const std::string &key) const;
+        // nullopt if the current value isn't an integer or the result would overflow
+        std::optional<long long> hincrby(const std::string &key, const std::string &field, long long delta);
 
+        //Probabilistic types
 
+        // Adds elements to key's HyperLogLog, creating it if needed. True if the key was
+        // created or a register changed; each element that changed one is logged as a PfAdd.
+        bool pfadd(const std::string &key, const std::vector<std::string> &elements);
+        // Estimated number of distinct elements across keys; missing keys count as empty
+        uint64_t pfcount(const std::vector<std::string> &keys) const;
+        // dest becomes the union of itself and sources, logged as a Restore of the result
+        void pfmerge(const std::string &dest, const std::vector<std::string> &sources);
 
+        // Creates an empty filter; false if key already exists
+        bool bfreserve(const std::string &key, double error_rate, size_t capacity);
+        // Adds items, creating a default-sized filter if needed. Per item, true if it was new.
+        std::vector<bool> bfadd(const std::string &key, const std::vector<std::string> &items);
+        std::vector<bool> bfexists(const std::string &key, const std::vector<std::string> &items) const;
 
+        // Replaces key with the HyperLogLog or Bloom filter serialized in bytes; false if they don't decode
+        bool restore(const std::string &key, std::string_view bytes);
 
+        //Expiry
+
+        // Expired keys read as missing; they are removed by the next write to them or by expire_due
         void setWithTTL(const std::string &key, const std::string &value, std::chrono::seconds ttl);
-        std::optional<std::string> getWithTTL(const std::string &key) const;
+        // Seconds left, -1 if the key has no expiry, -2 if it doesn't exist
+        long long ttl(const std::string &key) const;
+        // Removes every expired key, reporting each as an Expire mutation. Returns how many.
+        size_t expire_due();
 
+        //Resharding
 
+        // Starts moving keys to a new shard count; false if a reshard is already running or
+        // the count is 0, unchanged or above the maximum. Keys move in reshard_step batches,
+        // and until a key has moved it is looked up in both its old and its new shard.
+        bool reshard(size_t shards);
+        // Moves up to max_keys keys, finishing the reshard once every old shard is drained.
+        // Returns false once no reshard is running.
+        bool reshard_step(size_t max_keys = 1024);
+        ReshardStatus reshard_status() const;
+        size_t max_shards() const { return shards_.size(); }
 
     private:
+        // One map per shard; the variant index is the key's type, so every command
+        // needs a single lookup and a key can never exist as two types at once
+        using Value = std::variant<StringValue, ZSet, Hash, HyperLogLog, BloomFilter>;
+
+        using Clock = std::chrono::steady_clock;
+
         struct Shard
         {
             mutable std::shared_mutex mutex;
-            std::unordered_map<std::string, std::string> data;
-            std::unordered_map<std::string, ZSet> sorted_sets;
+            std::unordered_map<std::string, Value> keyspace;
+            std::unordered_map<std::string, Clock::time_point> expires; // keys with a TTL
+            std::unique_ptr<ChangeRing> changes; // null unless the change stream is enabled
+            std::unique_ptr<KeyIndex> index;     // null unless the key index is enabled
+            mutable std::atomic<uint64_t> version{0}; // bumped by every write lock before it unlocks
+            std::atomic<bool> settled{true}; // while resharding: every key here is in its new shard
+        };
 
+        // State of the running reshard, only touched under reshard_mutex_'s exclusive lock
+        struct Reshard
+        {
+            size_t source = 0;               // old shard being drained
+            std::vector<std::string> pending; // its keys that still have to move
+            size_t next = 0;                 // into pending
+            bool listed = false;             // pending holds source's keys
         };
 
-        std::vector<Shard> shards_;
-        size_t num_shards_;
+        template <typename Lock>
+        class ShardLock;
+        using ReadLock = ShardLock<std::shared_lock<std::shared_mutex>>;
+        using WriteLock = ShardLock<std::unique_lock<std::shared_mutex>>;
+
+        // One slot per possible shard, filled as shards come into use. Slots are never
+        // resized or emptied, so a reshard never moves a Shard that others may be reading.
+        std::vector<std::unique_ptr<Shard>> shards_;
+        // Keys hash over num_shards_; while resharding they are moving to a home over
+        // target_shards_. Both only change with every shard write-locked, and bump routing_epoch_.
+        std::atomic<size_t> num_shards_;
+        std::atomic<size_t> target_shards_;
+        std::atomic<uint64_t> routing_epoch_{0};
+        // Held exclusively while keys move and shared by whole-store scans, so a scan never
+        // sees a key twice or misses one in transit. Taken before any shard lock.
+        mutable std::shared_mutex reshard_mutex_;
+        Reshard reshard_;
+        std::atomic<size_t> reshard_sources_done_{0};
+        std::atomic<uint64_t> reshard_moved_{0};
+        WriteObserver observer_;
+        std::atomic<uint64_t> change_seq_{1};
+        size_t change_ring_bytes_ = 0; // per shard, 0 while the change stream is disabled
+        mutable HotKeys hot_keys_;
+        bool hot_cache_ = false;
+
+        class ReshardPause;
+        size_t shardsInUse() const { return std::max(num_shards_.load(), target_shards_.load()); }
+        // The shards key may live in: {old, new} while it can still be in transit, else {home, home}
+        std::pair<size_t, size_t> homes(const std::string &key) const;
+        // The shard holding key, or where it is created; caller holds the locks of its homes
         size_t getShard(const std::string &key) const;
+        // Creates and sets up shards [from, to) as needed; caller holds every shard lock in use
+        void prepareShards(size_t from, size_t to);
+        // Reports m to the observer and the change stream; caller holds the shard's write lock
+        void emit(size_t shard_index, const Mutation &m);
+        // Drops key if its TTL has passed; caller holds the shard's write lock
+        void purgeIfExpired(size_t shard_index, const std::string &key);
+        std::vector<std::pair<std::string, double>> zpop(const std::string &key, size_t count, bool max);
+        size_t zstore(const std::string &dest, const std::vector<std::string> &keys, const std::function<ZSet(const std::vector<const ZSet *> &)> &combine);
+        // Locks the shards listed by indexes (re-listed if a reshard changes routing meanwhile) and runs fn
+        void lock_shards_and_run(const std::function<std::vector<size_t>()> &indexes, const std::function<void()> &fn);
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+#include <chrono>
+#include <string_view>
+
+namespace kv
+{
+    // One effective change to the store, reported to the write observer and the change stream
+    struct Mutation
+    {
+        // Restore replaces a key with a HyperLogLog or Bloom filter from its serialized bytes
+        enum class Type { Set, Del, ZAdd, ZRem, HSet, HDel, Expire, PfAdd, BfAdd, Restore };
+
+        Type type = Type::Set;
+        std::string_view key;
+        std::string_view value; // SET/HSET value, ZADD/ZREM member, PFADD element, BF.ADD item, RESTORE bytes
+        double score = 0;
+        std::string_view field; // HSET/HDEL field
+        std::chrono::seconds ttl{0}; // SET with an expiry
+
+        static Mutation set(std::string_view key, std::string_view value, std::chrono::seconds ttl = std::chrono::seconds(0))
+        {
+            Mutation m = make(Type::Set, key, value);
+            m.ttl = ttl;
+            return m;
+        }
+        static Mutation del(std::string_view key) { return make(Type::Del, key); }
+        static Mutation expire(std::string_view key) { return make(Type::Expire, key); }
+        static Mutation zadd(std::string_view key, std::string_view member, double score)
+        {
+            Mutation m = make(Type::ZAdd, key, member);
+            m.score = score;
+            return m;
+        }
+        static Mutation zrem(std::string_view key, std::string_view member) { return make(Type::ZRem, key, member); }
+        static Mutation hset(std::string_view key, std::string_view field, std::string_view value)
+        {
+            Mutation m = make(Type::HSet, key, value);
+            m.field = field;
+            return m;
+        }
+        static Mutation hdel(std::string_view key, std::string_view field)
+        {
+            Mutation m = make(Type::HDel, key);
+            m.field = field;
+            return m;
+        }
+        static Mutation pfadd(std::string_view key, std::string_view element) { return make(Type::PfAdd, key, element); }
+        static Mutation bfadd(std::string_view key, std::string_view item) { return make(Type::BfAdd, key, item); }
+        static Mutation restore(std::string_view key, std::string_view bytes) { return make(Type::Restore, key, bytes); }
+
+    private:
+        static Mutation make(Type type, std::string_view key, std::string_view value = {})
+        {
+            Mutation m;
+            m.type = type;
+            m.key = key;
+            m.value = value;
+            return m;
+        }
+    };
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace kv {
+    // A string key's value. Values of kSharedFrom bytes or more live in an immutable
+    // refcounted buffer, so a reader takes a reference under the shard lock instead of a
+    // copy and the network layer sends straight from it; smaller ones are stored inline.
+    class StringValue {
+        public:
+            static constexpr size_t kSharedFrom = 16 * 1024;
+
+            StringValue() = default;
+            StringValue(const std::string &value) {
+                if (value.size() >= kSharedFrom) {
+                    shared_ = std::make_shared<const std::string>(value);
+                } else {
+                    inline_ = value;
+                }
+            }
+
+            std::string_view view() const { return shared_ ? std::string_view(*shared_) : std::string_view(inline_); }
+            size_t size() const { return shared_ ? shared_->size() : inline_.size(); }
+            bool is_shared() const { return shared_ != nullptr; }
+
+            // The stored buffer for large values, null for inline ones
+            const std::shared_ptr<const std::string> &shared() const { return shared_; }
+            // The stored buffer for large values, a copy for inline ones
+            std::shared_ptr<const std::string> share() const {
+                return shared_ ? shared_ : std::make_shared<const std::string>(inline_);
+            }
+
+        private:
+            std::string inline_;
+            std::shared_ptr<const std::string> shared_;
+    };
+}
@@ -1,11 +1,12 @@
 #include "zset.h"
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <limits>
 
 namespace kv
 {
-    ZSet::ZSet(int max_level) : rng_(std::random_device{}())
+    SkipList::SkipList(int max_level) : rng_(std::random_device{}())
     {
         max_level_ = max_level;
         current_level_ = 0;
@@ -14,7 +15,7 @@ namespace kv
         std::random_device rd;
     }
 
-    ZSet::~ZSet()
+    SkipList::~SkipList()
     {
         ZSetNode *current = head_;
 
@@ -26,7 +27,7 @@ namespace kv
         }
     }
 
-    int ZSet::randomLevel() const
+    int SkipList::randomLevel() const
     {
 
         int level = 1;
@@ -40,42 +41,99 @@ namespace kv
         return level;
     }
 
-    bool ZSet::add(const std::string &member, double score)
+    namespace
+    {
+        // Skip list order: by score, then by member
+        bool precedes(const ZSetNode *node, double score, const std::string &member)
+        {
+            return node->score < score || (node->score == score && node->member < member);
+        }
+    }
+
+    bool SkipList::add(const std::string &member, double score)
+    {
+        return add(member, score, ZAddOptions{}) != ZAddResult::Unchanged;
+    }
+
+    ZAddResult SkipList::add(const std::string &member, double score, const ZAddOptions &options)
     {
         auto it = node_map_.find(member);
 
-        if (it != node_map_.end())
+        if (it == node_map_.end())
         {
-            // Member already exists, update score
-            double old_score = it->second->score;
-
-            if (old_score == score)
+            if (options.xx)
             {
-                return false; // No change needed
+                return ZAddResult::Unchanged;
             }
 
-            remove(member);
+            std::vector<ZSetNode *> update(max_level_ + 1, nullptr);
+            findPredecessors(member, score, update);
+
+            ZSetNode *new_node = new ZSetNode(randomLevel(), member, score);
+            linkNode(new_node, update);
+            node_map_[member] = new_node;
+            length_++;
+            return ZAddResult::Added;
+        }
+
+        ZSetNode *node = it->second;
+        if (options.nx || node->score == score ||
+            (options.gt && score < node->score) || (options.lt && score > node->score))
+        {
+            return ZAddResult::Unchanged;
+        }
+
+        std::vector<ZSetNode *> update(max_level_ + 1, nullptr);
+        findPredecessors(member, node->score, update);
+
+        // Still between its neighbours: only the score changes
+        ZSetNode *next = node->forward[0];
+        if ((update[0] == head_ || precedes(update[0], score, member)) &&
+            (next == nullptr || !precedes(next, score, member)))
+        {
+            node->score = score;
+            return ZAddResult::Updated;
+        }
+
+        // Otherwise move the node itself; the member string and map entry stay put
+        unlinkNode(node, update);
+        node->score = score;
+        findPredecessors(member, score, update);
+        linkNode(node, update);
+        return ZAddResult::Updated;
+    }
+
+    bool SkipList::remove(const std::string &member)
+    {
+        auto it = node_map_.find(member);
+
+        if (it == node_map_.end())
+        {
+            return false;
         }
 
-        // New member
+        removeNode(it->second);
+        return true;
+    }
 
-        std::vector<ZSetNode *> update(max_level_, nullptr);
+    void SkipList::findPredecessors(const std::string &member, double score, std::vector<ZSetNode *> &update) const
+    {
         ZSetNode *current = head_;
 
         for (int i = current_level_; i >= 0; i--)
         {
-            while (current->forward[i] != nullptr &&
-                   (current->forward[i]->score < score ||
-                    (current->forward[i]->score == score && current->forward[i]->member < member)))
+            while (current->forward[i] != nullptr && precedes(current->forward[i], score, member))
             {
                 current = current->forward[i];
             }
             update[i] = current;
         }
+    }
 
-        int height = randomLevel();
-
-        // Now add the new node to the skip list
+    void SkipList::linkNode(ZSetNode *node, std::vector<ZSetNode *> &update)
+    {
+        // A node is linked on one level fewer than it has forward pointers
+        int height = static_cast<int>(node->forward.size()) - 1;
 
         if (height > current_level_)
         {
@@ -87,84 +145,142 @@ namespace kv
             current_level_ = height;
         }
 
-        ZSetNode *new_node = new ZSetNode(height, member, score);
-
         for (int i = 0; i < height; i++)
         {
-            new_node->forward[i] = update[i]->forward[i];
-            update[i]->forward[i] = new_node;
+            node->forward[i] = update[i]->forward[i];
+            update[i]->forward[i] = node;
         }
 
-        node_map_[member] = new_node;
-        length_++;
-
-        return true;
+        if (node->forward[0] == nullptr)
+        {
+            tail_ = node;
+        }
     }
 
-    bool ZSet::remove(const std::string &member)
+    void SkipList::unlinkNode(ZSetNode *node, const std::vector<ZSetNode *> &update)
     {
-        // first check if the member exists
+        // Every level the node is on, the topmost included
+        for (int i = 0; i <= current_level_; i++)
+        {
+            if (update[i]->forward[i] != node)
+            {
+                break;
+            }
 
-        auto it = node_map_.find(member);
+            update[i]->forward[i] = node->forward[i];
+        }
 
-        if (it != node_map_.end())
+        while (current_level_ > 0 && head_->forward[current_level_] == nullptr)
         {
-            // It exists, lets remove it
+            current_level_--;
+        }
 
-            ZSetNode *node_to_remove = it->second; // get the node to remove
-            double score = node_to_remove->score;
+        if (tail_ == node)
+        {
+            tail_ = update[0] == head_ ? nullptr : update[0];
+        }
+    }
 
-            // Now we remove
+    void SkipList::removeNode(ZSetNode *node)
+    {
+        std::vector<ZSetNode *> update(max_level_ + 1, nullptr);
+        findPredecessors(node->member, node->score, update);
+        unlinkNode(node, update);
 
-            std::vector<ZSetNode *> update(max_level_, nullptr);
-            ZSetNode *current = head_;
+        node_map_.erase(node->member);
+        delete node;
+        length_--;
+    }
 
-            for (int i = current_level_; i >= 0; i--)
+    void SkipList::build(std::vector<std::pair<std::string, double>> &&pairs)
+    {
+        if (length_ > 0)
+        {
+            for (const auto &[member, score] : pairs)
             {
-                while (current->forward[i] != nullptr &&
-                       (current->forward[i]->score < score ||
-                        (current->forward[i]->score == score && current->forward[i]->member < member)))
-                {
-                    current = current->forward[i];
-                }
-                update[i] = current;
+                add(member, score);
             }
+            return;
+        }
 
-            current = current->forward[0];
+        node_map_.reserve(pairs.size());
+        std::vector<ZSetNode *> nodes;
+        nodes.reserve(pairs.size());
 
-            if (current == nullptr || current->member != member)
+        for (auto &[member, score] : pairs)
+        {
+            auto [it, inserted] = node_map_.try_emplace(member, nullptr);
+            if (inserted)
             {
-                return false;
+                // Sized for level 1, which is where half the nodes stay
+                it->second = new ZSetNode(1, std::move(member), score);
+                nodes.push_back(it->second);
             }
+            else
+            {
+                it->second->score = score;
+            }
+        }
 
-            // Do stuff here
-
-            for (int i = 0; i < current_level_; i++) {
-                if (update[i]->forward[i] != current) {
-                    break;
-                }
+        auto before = [](const ZSetNode *a, const ZSetNode *b) {
+            return a->score < b->score || (a->score == b->score && a->member < b->member);
+        };
+        if (!std::is_sorted(nodes.begin(), nodes.end(), before))
+        {
+            std::sort(nodes.begin(), nodes.end(), before);
+        }
 
-                update[i]->forward[i] = current->forward[i];
+        std::vector<ZSetNode *> last(max_level_ + 1, head_);
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            ZSetNode *node = nodes[i];
+            int height = std::min(max_level_, 1 + __builtin_ctzll(i + 1));
+            if (height > 1)
+            {
+                node->forward.resize(height + 1, nullptr);
             }
 
-            while (current_level_ > 0 && head_->forward[current_level_] == nullptr) {
-                current_level_--;
+            for (int level = 0; level < height; level++)
+            {
+                last[level]->forward[level] = node;
+                last[level] = node;
             }
 
-            node_map_.erase(it); // remove from map
+            current_level_ = std::max(current_level_, height);
+        }
+
+        tail_ = nodes.empty() ? nullptr : nodes.back();
+        length_ = nodes.size();
+    }
 
-            delete current; // free memory
-            length_--;
-            return true;
+    std::vector<std::pair<std::string, double>> SkipList::pop_min(size_t count)
+    {
+        std::vector<std::pair<std::string, double>> res;
 
-            // Now handle the skip list pointers
+        // The first node's predecessor is head_ on every level, so each pop is O(height)
+        while (res.size() < count && head_->forward[0] != nullptr)
+        {
+            ZSetNode *node = head_->forward[0];
+            res.emplace_back(node->member, node->score);
+            removeNode(node);
         }
+        return res;
+    }
 
-        // It does not exist
-        return false;
+    std::vector<std::pair<std::string, double>> SkipList::pop_max(size_t count)
+    {
+        std::vector<std::pair<std::string, double>> res;
+
+        // tail_ finds the node; unlinking it is one O(log n) search for its predecessors
+        while (res.size() < count && tail_ != nullptr)
+        {
+            res.emplace_back(tail_->member, tail_->score);
+            removeNode(tail_);
+        }
+        return res;
     }
 
-    std::optional<double> ZSet::score(const std::string &member) const
+    std::optional<double> SkipList::score(const std::string &member) const
     {
         auto it = node_map_.find(member);
 
@@ -175,7 +291,7 @@ namespace kv
         return std::nullopt;
     }
 
-    std::optional<int> ZSet::rank(const std::string &member) const
+    std::optional<int> SkipList::rank(const std::string &member) const
     {
         if (node_map_.find(member) == node_map_.end())
         {
@@ -215,7 +331,7 @@ namespace kv
         return rank;
     }
 
-    std::vector<std::pair<std::string, double>> ZSet::range(int start, int stop) const
+    std::vector<std::pair<std::string, double>> SkipList::range(int start, int stop) const
     {
         //Go through lowest level
 
@@ -239,7 +355,7 @@ namespace kv
             start = 0;
         }
 
-        if (stop >= length_) {
+        if (stop >= static_cast<int>(length_)) {
             stop = length_ - 1;
         }
 
@@ -268,7 +384,7 @@ namespace kv
         
     }
 
-    ZSetNode *ZSet::findNode(const std::string &member, double score) const
+    ZSetNode *SkipList::findNode(const std::string &member, double score) const
     {
         //Start looking for the node from the head
 
@@ -297,14 +413,241 @@ namespace kv
             return nullptr;
     }
 
-    std::vector<std::pair<std::string, double>> ZSet::all() const {
+    std::vector<std::pair<std::string, double>> SkipList::all() const {
         std::vector<std::pair<std::string, double>> res;
 
         return range(0, -1);
     }
 
-    size_t ZSet::size() const
+    size_t SkipList::size() const
     {
         return length_;
     }
+
+    namespace
+    {
+        std::atomic<size_t> default_max_packed_entries{ZSet::kDefaultMaxPacked};
+
+        bool precedes(const std::pair<std::string, double> &entry, double score, const std::string &member)
+        {
+            return entry.second < score || (entry.second == score && entry.first < member);
+        }
+    }
+
+    void ZSet::set_default_max_packed(size_t entries)
+    {
+        default_max_packed_entries.store(entries, std::memory_order_relaxed);
+    }
+
+    size_t ZSet::default_max_packed()
+    {
+        return default_max_packed_entries.load(std::memory_order_relaxed);
+    }
+
+    ZSet::ZSet(int max_level, size_t max_packed) : max_level_(max_level), max_packed_(max_packed)
+    {
+        if (max_packed_ == 0)
+        {
+            list_ = std::make_unique<SkipList>(max_level_);
+        }
+    }
+
+    std::vector<ZSet::Entry>::iterator ZSet::findPacked(const std::string &member)
+    {
+        return std::find_if(packed_.begin(), packed_.end(), [&](const Entry &e) { return e.first == member; });
+    }
+
+    std::vector<ZSet::Entry>::const_iterator ZSet::findPacked(const std::string &member) const
+    {
+        return std::find_if(packed_.begin(), packed_.end(), [&](const Entry &e) { return e.first == member; });
+    }
+
+    std::vector<ZSet::Entry>::iterator ZSet::packedLowerBound(const std::string &member, double score)
+    {
+        return std::lower_bound(packed_.begin(), packed_.end(), score, [&](const Entry &e, double s) { return precedes(e, s, member); });
+    }
+
+    void ZSet::promote()
+    {
+        // Already sorted and unique, so the bulk build skips its sort
+        list_ = std::make_unique<SkipList>(max_level_);
+        list_->build(std::move(packed_));
+        std::vector<Entry>().swap(packed_);
+    }
+
+    bool ZSet::add(const std::string &member, double score)
+    {
+        return add(member, score, ZAddOptions{}) != ZAddResult::Unchanged;
+    }
+
+    ZAddResult ZSet::add(const std::string &member, double score, const ZAddOptions &options)
+    {
+        if (list_ != nullptr)
+        {
+            return list_->add(member, score, options);
+        }
+
+        auto it = findPacked(member);
+        if (it == packed_.end())
+        {
+            if (options.xx)
+            {
+                return ZAddResult::Unchanged;
+            }
+            if (packed_.size() >= max_packed_)
+            {
+                promote();
+                return list_->add(member, score, options);
+            }
+
+            packed_.emplace(packedLowerBound(member, score), member, score);
+            return ZAddResult::Added;
+        }
+
+        if (options.nx || it->second == score ||
+            (options.gt && score < it->second) || (options.lt && score > it->second))
+        {
+            return ZAddResult::Unchanged;
+        }
+
+        // Still between its neighbours: only the score changes
+        if ((it == packed_.begin() || precedes(*(it - 1), score, member)) &&
+            (it + 1 == packed_.end() || !precedes(*(it + 1), score, member)))
+        {
+            it->second = score;
+            return ZAddResult::Updated;
+        }
+
+        Entry entry = std::move(*it);
+        packed_.erase(it);
+        entry.second = score;
+        packed_.insert(packedLowerBound(member, score), std::move(entry));
+        return ZAddResult::Updated;
+    }
+
+    bool ZSet::remove(const std::string &member)
+    {
+        if (list_ != nullptr)
+        {
+            return list_->remove(member);
+        }
+
+        auto it = findPacked(member);
+        if (it == packed_.end())
+        {
+            return false;
+        }
+        packed_.erase(it);
+        return true;
+    }
+
+    std::optional<double> ZSet::score(const std::string &member) const
+    {
+        if (list_ != nullptr)
+        {
+            return list_->score(member);
+        }
+
+        auto it = findPacked(member);
+        if (it == packed_.end())
+        {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    std::optional<int> ZSet::rank(const std::string &member) const
+    {
+        if (list_ != nullptr)
+        {
+            return list_->rank(member);
+        }
+
+        auto it = findPacked(member);
+        if (it == packed_.end())
+        {
+            return std::nullopt;
+        }
+        return static_cast<int>(it - packed_.begin());
+    }
+
+    std::vector<std::pair<std::string, double>> ZSet::range(int start, int stop) const
+    {
+        if (list_ != nullptr)
+        {
+            return list_->range(start, stop);
+        }
+
+        int length = static_cast<int>(packed_.size());
+        if (start < 0)
+        {
+            start = std::max(length + start, 0);
+        }
+        if (stop < 0)
+        {
+            stop = length + stop;
+        }
+        stop = std::min(stop, length - 1);
+
+        if (start > stop)
+        {
+            return {};
+        }
+        return std::vector<Entry>(packed_.begin() + start, packed_.begin() + stop + 1);
+    }
+
+    size_t ZSet::size() const
+    {
+        return list_ != nullptr ? list_->size() : packed_.size();
+    }
+
+    std::vector<std::pair<std::string, double>> ZSet::all() const
+    {
+        return list_ != nullptr ? list_->all() : packed_;
+    }
+
+    void ZSet::build(std::vector<std::pair<std::string, double>> &&pairs)
+    {
+        if (list_ == nullptr && packed_.size() + pairs.size() > max_packed_)
+        {
+            promote();
+        }
+
+        if (list_ != nullptr)
+        {
+            list_->build(std::move(pairs));
+            return;
+        }
+
+        for (const auto &[member, score] : pairs)
+        {
+            add(member, score);
+        }
+    }
+
+    std::vector<std::pair<std::string, double>> ZSet::pop_min(size_t count)
+    {
+        if (list_ != nullptr)
+        {
+            return list_->pop_min(count);
+        }
+
+        count = std::min(count, packed_.size());
+        std::vector<Entry> res(std::make_move_iterator(packed_.begin()), std::make_move_iterator(packed_.begin() + count));
+        packed_.erase(packed_.begin(), packed_.begin() + count);
+        return res;
+    }
+
+    std::vector<std::pair<std::string, double>> ZSet::pop_max(size_t count)
+    {
+        if (list_ != nullptr)
+        {
+            return list_->pop_max(count);
+        }
+
+        count = std::min(count, packed_.size());
+        std::vector<Entry> res(std::make_move_iterator(packed_.rbegin()), std::make_move_iterator(packed_.rbegin() + count));
+        packed_.erase(packed_.end() - count, packed_.end());
+        return res;
+    }
 }
@@ -6,6 +6,7 @@
 #include <vector>
 #include <chrono>
 #include <random>
+#include <memory>
 
 
 namespace kv {
@@ -14,16 +15,40 @@ namespace kv {
         double score;
         std::vector<ZSetNode*> forward;
 
-        ZSetNode(int level, const std::string &member, double score) : member(member), score(score), forward(level + 1, nullptr) {}
+        ZSetNode(int level, std::string member, double score) : member(std::move(member)), score(score), forward(level + 1, nullptr) {}
     };
 
-    class ZSet {
+    // ZADD's NX/XX/GT/LT conditions. GT/LT only restrict updates; new members are still added.
+    // ch doesn't affect the set: it asks KVStore::zadd to count updated members as well as added ones.
+    struct ZAddOptions {
+        bool nx = false; // only add new members
+        bool xx = false; // only update existing members
+        bool gt = false; // only update to a greater score
+        bool lt = false; // only update to a lesser score
+        bool ch = false;
+
+        bool unconditional() const { return !nx && !xx && !gt && !lt; }
+    };
+
+    enum class ZAddResult { Unchanged, Added, Updated };
+
+    // The skip list a ZSet switches to once it outgrows its packed array.
+    // Ordered by (score, member), with node_map_ for member lookups.
+    class SkipList {
         public:
 
-            ZSet(int max_level = 16);
-            ~ZSet();
+            explicit SkipList(int max_level);
+            ~SkipList();
 
+            // Owns its nodes; ZSet holds it by pointer
+            SkipList(const SkipList &) = delete;
+            SkipList &operator=(const SkipList &) = delete;
+
+            // Returns true if member is new or its score changed
             bool add(const std::string &member, double score);
+            // A score change that keeps the node between its neighbours is made in place;
+            // otherwise the node is relinked without reallocating it
+            ZAddResult add(const std::string &member, double score, const ZAddOptions &options);
             bool remove(const std::string &member);
             std::optional<double> score(const std::string &member) const;
             std::optional<int> rank(const std::string &member) const;
@@ -31,10 +56,31 @@ namespace kv {
             size_t size() const;
 
             std::vector<std::pair<std::string, double>> all() const;
+
+            // Visits members in order without copying them out
+            template <typename Fn>
+            void for_each(Fn &&fn) const
+            {
+                for (ZSetNode *node = head_->forward[0]; node != nullptr; node = node->forward[0])
+                {
+                    fn(node->member, node->score);
+                }
+            }
+
+            // Bulk construction: one sort, no per-member descents and no RNG.
+            // Levels are built bottom-up over the sorted nodes (every node on level 0, every 2nd
+            // on level 1, every 4th on level 2, ...) in one linear pass. A later pair for the
+            // same member wins, as with one add per pair. Adds one by one if the set isn't empty.
+            void build(std::vector<std::pair<std::string, double>> &&pairs);
+
+            // Remove and return up to count members with the lowest/highest scores, in pop order
+            std::vector<std::pair<std::string, double>> pop_min(size_t count);
+            std::vector<std::pair<std::string, double>> pop_max(size_t count);
             
         
         private:
             ZSetNode *head_;
+            ZSetNode *tail_ = nullptr; // last node on level 0, nullptr when empty
             int max_level_;
             int current_level_;
             size_t length_;
@@ -42,5 +88,79 @@ namespace kv {
             std::mt19937 rng_;
             int randomLevel() const;
             ZSetNode* findNode(const std::string &member, double score) const;
+            // Fills update[i] with the last node on level i ordered before (score, member)
+            void findPredecessors(const std::string &member, double score, std::vector<ZSetNode *> &update) const;
+            void linkNode(ZSetNode *node, std::vector<ZSetNode *> &update);
+            void unlinkNode(ZSetNode *node, const std::vector<ZSetNode *> &update);
+            // Unlinks node from every level and frees it
+            void removeNode(ZSetNode *node);
+    };
+
+    // Sorted set. Small sets are one vector of (member, score) sorted by (score, member):
+    // about 40 bytes plus the entries, no per-member nodes and no hash map. Lookups by member
+    // scan it, lookups by position index it. Once an add would take it past max_packed
+    // entries it is converted to a SkipList for good.
+    class ZSet {
+        public:
+            using ZAddResult = kv::ZAddResult;
+
+            static constexpr size_t kDefaultMaxPacked = 64;
+
+            // Threshold for ZSets constructed afterwards; set before the store is shared
+            static void set_default_max_packed(size_t entries);
+            static size_t default_max_packed();
+
+            explicit ZSet(int max_level = 16, size_t max_packed = default_max_packed());
+
+            // Returns true if member is new or its score changed
+            bool add(const std::string &member, double score);
+            // A score change that keeps the member between its neighbours is made in place
+            ZAddResult add(const std::string &member, double score, const ZAddOptions &options);
+            bool remove(const std::string &member);
+            std::optional<double> score(const std::string &member) const;
+            std::optional<int> rank(const std::string &member) const;
+            std::vector<std::pair<std::string, double>> range(int start, int stop) const;
+            size_t size() const;
+
+            std::vector<std::pair<std::string, double>> all() const;
+
+            // Visits members in order without copying them out
+            template <typename Fn>
+            void for_each(Fn &&fn) const
+            {
+                if (list_ != nullptr)
+                {
+                    list_->for_each(fn);
+                    return;
+                }
+                for (const auto &[member, score] : packed_)
+                {
+                    fn(member, score);
+                }
+            }
+
+            // Bulk construction from unsorted pairs; a later pair for the same member wins.
+            // Pairs that fit the packed array are added to it, the rest go to SkipList::build.
+            void build(std::vector<std::pair<std::string, double>> &&pairs);
+
+            // Remove and return up to count members with the lowest/highest scores, in pop order
+            std::vector<std::pair<std::string, double>> pop_min(size_t count);
+            std::vector<std::pair<std::string, double>> pop_max(size_t count);
+
+            bool is_packed() const { return list_ == nullptr; }
+
+        private:
+            using Entry = std::pair<std::string, double>;
+
+            std::vector<Entry>::iterator findPacked(const std::string &member);
+            std::vector<Entry>::const_iterator findPacked(const std::string &member) const;
+            // First entry not ordered before (score, member)
+            std::vector<Entry>::iterator packedLowerBound(const std::string &member, double score);
+            void promote();
+
+            std::vector<Entry> packed_;      // empty once list_ exists
+            std::unique_ptr<SkipList> list_; // null while packed
+            int max_level_;
+            size_t max_packed_;
     };
 }
\ No newline at end of file
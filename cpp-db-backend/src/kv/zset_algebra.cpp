@@ -0,0 +1,280 @@
+#include "zset_algebra.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+
+namespace kv
+{
+    namespace
+    {
+        using Entry = std::pair<std::string, double>;
+
+        // Below this many input members a union isn't worth the threads
+        constexpr size_t kParallelUnionThreshold = 1 << 16;
+        constexpr size_t kMaxUnionThreads = 8;
+
+        double weighted(double score, double weight)
+        {
+            double res = score * weight;
+            return std::isnan(res) ? 0 : res; // inf * 0
+        }
+
+        double combine(double a, double b, Aggregate aggregate)
+        {
+            switch (aggregate)
+            {
+            case Aggregate::Min:
+                return std::min(a, b);
+            case Aggregate::Max:
+                return std::max(a, b);
+            case Aggregate::Sum:
+                break;
+            }
+            double sum = a + b;
+            return std::isnan(sum) ? 0 : sum; // inf + -inf
+        }
+
+        // Skip list order
+        bool before(const Entry &a, const Entry &b)
+        {
+            return a.second < b.second || (a.second == b.second && a.first < b.first);
+        }
+
+        // Runs fn(0..n-1), one call per thread (the caller runs 0)
+        template <typename Fn>
+        void runParallel(size_t n, Fn &&fn)
+        {
+            std::vector<std::thread> workers;
+            for (size_t i = 1; i < n; i++)
+            {
+                workers.emplace_back([&fn, i]() { fn(i); });
+            }
+            fn(0);
+            for (auto &worker : workers)
+            {
+                worker.join();
+            }
+        }
+
+        std::vector<Entry> sorted(std::vector<Entry> &&entries)
+        {
+            std::sort(entries.begin(), entries.end(), before);
+            return std::move(entries);
+        }
+
+        std::vector<Entry> unionSerial(const std::vector<const ZSet *> &sets, const std::vector<double> &weights, Aggregate aggregate, size_t expected)
+        {
+            std::unordered_map<std::string, double> acc;
+            acc.reserve(expected);
+            for (size_t i = 0; i < sets.size(); i++)
+            {
+                if (sets[i] == nullptr)
+                {
+                    continue;
+                }
+                sets[i]->for_each([&](const std::string &member, double score) {
+                    double value = weighted(score, weights[i]);
+                    auto [it, inserted] = acc.try_emplace(member, value);
+                    if (!inserted)
+                    {
+                        it->second = combine(it->second, value, aggregate);
+                    }
+                });
+            }
+
+            std::vector<Entry> res;
+            res.reserve(acc.size());
+            for (auto &node : acc)
+            {
+                res.emplace_back(node.first, node.second);
+            }
+            return sorted(std::move(res));
+        }
+
+        // An input member with its hash, computed once and reused by the partition's map
+        struct Hashed
+        {
+            const std::string *member;
+            size_t hash;
+            double value;
+        };
+
+        struct HashedHash
+        {
+            size_t operator()(const Hashed &h) const { return h.hash; }
+        };
+
+        struct HashedEqual
+        {
+            bool operator()(const Hashed &a, const Hashed &b) const { return *a.member == *b.member; }
+        };
+
+        // Each input member is visited and hashed once: one walk flattens the sets, workers
+        // hash slices of that into per-partition buckets, then each partition aggregates its
+        // buckets (in input order, so results match the serial union exactly) and sorts them
+        std::vector<std::vector<Entry>> unionPartitioned(const std::vector<const ZSet *> &sets, const std::vector<double> &weights,
+                                                        Aggregate aggregate, size_t partitions, size_t total)
+        {
+            std::vector<std::pair<const std::string *, double>> flat;
+            flat.reserve(total);
+            for (size_t i = 0; i < sets.size(); i++)
+            {
+                if (sets[i] != nullptr)
+                {
+                    sets[i]->for_each([&](const std::string &member, double score) { flat.emplace_back(&member, weighted(score, weights[i])); });
+                }
+            }
+
+            // buckets[worker][partition]
+            std::vector<std::vector<std::vector<Hashed>>> buckets(partitions, std::vector<std::vector<Hashed>>(partitions));
+            runParallel(partitions, [&](size_t worker) {
+                std::hash<std::string> hasher;
+                auto &mine = buckets[worker];
+                for (auto &bucket : mine)
+                {
+                    bucket.reserve(flat.size() / partitions / partitions + 16);
+                }
+                size_t begin = flat.size() * worker / partitions;
+                size_t end = flat.size() * (worker + 1) / partitions;
+                for (size_t i = begin; i < end; i++)
+                {
+                    size_t hash = hasher(*flat[i].first);
+                    mine[hash % partitions].push_back(Hashed{flat[i].first, hash, flat[i].second});
+                }
+            });
+
+            std::vector<std::vector<Entry>> runs(partitions);
+            runParallel(partitions, [&](size_t partition) {
+                std::unordered_map<Hashed, double, HashedHash, HashedEqual> acc;
+                acc.reserve(total / partitions);
+                for (size_t worker = 0; worker < partitions; worker++)
+                {
+                    for (const Hashed &h : buckets[worker][partition])
+                    {
+                        auto [it, inserted] = acc.try_emplace(h, h.value);
+                        if (!inserted)
+                        {
+                            it->second = combine(it->second, h.value, aggregate);
+                        }
+                    }
+                }
+
+                std::vector<Entry> res;
+                res.reserve(acc.size());
+                for (auto &node : acc)
+                {
+                    res.emplace_back(*node.first.member, node.second);
+                }
+                runs[partition] = sorted(std::move(res));
+            });
+            return runs;
+        }
+
+        // k-way merge of sorted runs whose members are disjoint
+        std::vector<Entry> mergeRuns(std::vector<std::vector<Entry>> &runs)
+        {
+            size_t total = 0;
+            for (const auto &run : runs)
+            {
+                total += run.size();
+            }
+
+            std::vector<Entry> res;
+            res.reserve(total);
+
+            std::vector<size_t> pos(runs.size(), 0);
+            auto later = [&](size_t a, size_t b) { return before(runs[b][pos[b]], runs[a][pos[a]]); };
+            std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heads(later);
+
+            for (size_t r = 0; r < runs.size(); r++)
+            {
+                if (!runs[r].empty())
+                {
+                    heads.push(r);
+                }
+            }
+
+            while (!heads.empty())
+            {
+                size_t r = heads.top();
+                heads.pop();
+                res.push_back(std::move(runs[r][pos[r]++]));
+                if (pos[r] < runs[r].size())
+                {
+                    heads.push(r);
+                }
+            }
+            return res;
+        }
+    }
+
+    ZSet zunion(const std::vector<const ZSet *> &sets, const std::vector<double> &weights, Aggregate aggregate, size_t threads)
+    {
+        size_t total = 0;
+        for (const ZSet *set : sets)
+        {
+            total += set ? set->size() : 0;
+        }
+
+        // Large unions: each thread owns a hash partition of the members, aggregates and sorts
+        // it independently, and the sorted partitions are merged at the end
+        size_t partitions = threads;
+        if (partitions == 0)
+        {
+            partitions = total >= kParallelUnionThreshold ? std::clamp<size_t>(std::thread::hardware_concurrency(), 1, kMaxUnionThreads) : 1;
+        }
+
+        ZSet res;
+        if (partitions == 1)
+        {
+            res.build(unionSerial(sets, weights, aggregate, total));
+        }
+        else
+        {
+            auto runs = unionPartitioned(sets, weights, aggregate, partitions, total);
+            res.build(mergeRuns(runs));
+        }
+        return res;
+    }
+
+    ZSet zinter(const std::vector<const ZSet *> &sets, const std::vector<double> &weights, Aggregate aggregate)
+    {
+        ZSet res;
+        if (sets.empty() || std::find(sets.begin(), sets.end(), nullptr) != sets.end())
+        {
+            return res;
+        }
+
+        // Walk the smallest set and probe the others, so the work is bounded by its size
+        std::vector<size_t> order(sets.size());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sets[a]->size() < sets[b]->size(); });
+
+        std::vector<Entry> out;
+        sets[order[0]]->for_each([&](const std::string &member, double score) {
+            double value = weighted(score, weights[order[0]]);
+
+            for (size_t k = 1; k < order.size(); k++)
+            {
+                auto other = sets[order[k]]->score(member);
+                if (!other)
+                {
+                    return;
+                }
+                value = combine(value, weighted(*other, weights[order[k]]), aggregate);
+            }
+
+            out.emplace_back(member, value);
+        });
+
+        std::sort(out.begin(), out.end(), before);
+        res.build(std::move(out));
+        return res;
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include "zset.h"
+#include <vector>
+
+namespace kv
+{
+    enum class Aggregate { Sum, Min, Max };
+
+    // ZUNIONSTORE/ZINTERSTORE on already-locked sets. A null entry is a missing key.
+    // weights has one entry per set; the result is built with ZSet::build.
+    // threads = 0 lets big unions use up to one thread per core.
+    ZSet zunion(const std::vector<const ZSet *> &sets, const std::vector<double> &weights, Aggregate aggregate, size_t threads = 0);
+    ZSet zinter(const std::vector<const ZSet *> &sets, const std::vector<double> &weights, Aggregate aggregate);
+}
@@ -1,10 +1,12 @@
 #include "net/tcp_server.h"
 #include <iostream>
 #include <csignal>
+#include <cstring>
+#include <string>
 
 kv::TCPServer* server_ptr = nullptr;
 
-void signal_handler(int signal) {
+void signal_handler(int) {
     if (server_ptr) {
         std::cout << "\nShutting down server..." << std::endl;
         server_ptr->stop();
@@ -12,19 +14,91 @@ void signal_handler(int signal) {
     }
 }
 
-int main() {
+void print_usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--port N] [--backend threads|uring] [--replicaof HOST PORT] [--cdc [BYTES_PER_SHARD]] [--zset-max-packed N] [--hot-cache] [--key-index] [--acceptors N] [--unix PATH] [--sndbuf BYTES] [--rcvbuf BYTES]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int port = 8080;
+    kv::Backend backend = kv::Backend::Threads;
+    std::string primary_host;
+    int primary_port = 0;
+    size_t cdc_bytes = 0;
+    bool hot_cache = false;
+    bool key_index = false;
+    kv::ListenOptions listen_options;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = std::stoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "uring") {
+                backend = kv::Backend::IoUring;
+            } else if (name == "threads") {
+                backend = kv::Backend::Threads;
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--replicaof") == 0 && i + 2 < argc) {
+            primary_host = argv[++i];
+            primary_port = std::stoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--cdc") == 0) {
+            cdc_bytes = 1 << 20;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                cdc_bytes = std::stoull(argv[++i]);
+            }
+        } else if (std::strcmp(argv[i], "--zset-max-packed") == 0 && i + 1 < argc) {
+            kv::ZSet::set_default_max_packed(std::stoull(argv[++i]));
+        } else if (std::strcmp(argv[i], "--hot-cache") == 0) {
+            hot_cache = true;
+        } else if (std::strcmp(argv[i], "--key-index") == 0) {
+            key_index = true;
+        } else if (std::strcmp(argv[i], "--acceptors") == 0 && i + 1 < argc) {
+            listen_options.acceptors = std::stoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--unix") == 0 && i + 1 < argc) {
+            listen_options.unix_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--sndbuf") == 0 && i + 1 < argc) {
+            listen_options.send_buffer = std::stoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--rcvbuf") == 0 && i + 1 < argc) {
+            listen_options.recv_buffer = std::stoi(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
     try {
-        kv::TCPServer server(8080);
+        kv::TCPServer server(port, 16, backend);
         server_ptr = &server;
+
+        if (!primary_host.empty()) {
+            server.set_replica_of(primary_host, primary_port);
+        }
+
+        if (cdc_bytes > 0) {
+            server.enable_change_stream(cdc_bytes);
+        }
+
+        if (hot_cache) {
+            server.enable_hot_key_cache();
+        }
+
+        if (key_index) {
+            server.enable_key_index();
+        }
+
+        server.set_listen_options(listen_options);
         
         // Handle Ctrl+C gracefully
         std::signal(SIGINT, signal_handler);
         
-        std::cout << "Starting TCP server on port 8080..." << std::endl;
+        std::cout << "Starting TCP server on port " << port << "..." << std::endl;
         server.start();
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,61 @@
+#include "arena.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace kv
+{
+    void *Arena::allocate(size_t bytes, size_t align)
+    {
+        while (true)
+        {
+            if (current_ < chunks_.size())
+            {
+                Chunk &chunk = chunks_[current_];
+                uintptr_t base = reinterpret_cast<uintptr_t>(chunk.data.get());
+                size_t offset = ((base + used_ + align - 1) & ~(uintptr_t(align) - 1)) - base;
+                if (offset + bytes <= chunk.size)
+                {
+                    used_ = offset + bytes;
+                    return chunk.data.get() + offset;
+                }
+
+                // Move on to the next kept chunk if there is one
+                if (current_ + 1 < chunks_.size() && chunks_[current_ + 1].size >= bytes + align)
+                {
+                    current_++;
+                    used_ = 0;
+                    continue;
+                }
+            }
+
+            // New chunk right after the current one; sizes double so a big batch needs few of them
+            size_t size = std::max(chunk_size_, bytes + align);
+            chunk_size_ = std::min(chunk_size_ * 2, kMaxRetained);
+            size_t at = chunks_.empty() ? 0 : current_ + 1;
+            chunks_.insert(chunks_.begin() + at, Chunk{std::unique_ptr<char[]>(new char[size]), size});
+            current_ = at;
+            used_ = 0;
+        }
+    }
+
+    void Arena::rewind(Mark mark)
+    {
+        current_ = mark.chunk;
+        used_ = mark.used;
+
+        if (current_ == 0 && used_ == 0 && chunks_.size() > 1 && reserved() > kMaxRetained)
+        {
+            chunks_.resize(1);
+        }
+    }
+
+    size_t Arena::reserved() const
+    {
+        size_t total = 0;
+        for (const Chunk &chunk : chunks_)
+        {
+            total += chunk.size;
+        }
+        return total;
+    }
+}
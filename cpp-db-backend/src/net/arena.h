@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace kv {
+    // Bump allocator for short-lived request data.
+    // Allocation is a pointer bump inside the current chunk; nothing is freed individually.
+    // rewind() drops everything allocated since a mark at once, and the chunks are kept, so
+    // once a thread has seen its biggest batch, parsing the next one never calls malloc.
+    class Arena {
+        public:
+            static constexpr size_t kDefaultChunkSize = 4096;
+            // Rewinding to empty frees all but the first chunk past this much
+            static constexpr size_t kMaxRetained = 1 << 20;
+
+            struct Mark {
+                size_t chunk;
+                size_t used;
+            };
+
+            explicit Arena(size_t chunk_size = kDefaultChunkSize) : chunk_size_(chunk_size) {}
+
+            Arena(const Arena &) = delete;
+            Arena &operator=(const Arena &) = delete;
+
+            void *allocate(size_t bytes, size_t align);
+
+            Mark mark() const { return {current_, used_}; }
+            void rewind(Mark mark);
+
+            size_t chunks() const { return chunks_.size(); }
+            size_t reserved() const;
+
+        private:
+            struct Chunk {
+                std::unique_ptr<char[]> data;
+                size_t size;
+            };
+
+            std::vector<Chunk> chunks_;
+            size_t current_ = 0; // chunk being bumped
+            size_t used_ = 0;    // bytes taken from chunks_[current_]
+            size_t chunk_size_;
+    };
+
+    // Rewinds to the mark taken at construction
+    class ArenaScope {
+        public:
+            explicit ArenaScope(Arena &arena) : arena_(arena), mark_(arena.mark()) {}
+            ~ArenaScope() { arena_.rewind(mark_); }
+
+            ArenaScope(const ArenaScope &) = delete;
+            ArenaScope &operator=(const ArenaScope &) = delete;
+
+        private:
+            Arena &arena_;
+            Arena::Mark mark_;
+    };
+
+    // Standard allocator over an Arena; deallocate is a no-op
+    template <typename T>
+    struct ArenaAllocator {
+        using value_type = T;
+
+        Arena *arena;
+
+        ArenaAllocator(Arena &a) noexcept : arena(&a) {}
+        template <typename U>
+        ArenaAllocator(const ArenaAllocator<U> &other) noexcept : arena(other.arena) {}
+
+        T *allocate(size_t n) { return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))); }
+        void deallocate(T *, size_t) noexcept {}
+
+        template <typename U>
+        bool operator==(const ArenaAllocator<U> &other) const noexcept { return arena == other.arena; }
+        template <typename U>
+        bool operator!=(const ArenaAllocator<U> &other) const noexcept { return arena != other.arena; }
+    };
+
+    template <typename T>
+    using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+}
@@ -0,0 +1,210 @@
+#include "io_uring.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace kv
+{
+    IoUring::~IoUring()
+    {
+        if (buf_ring_ != nullptr)
+        {
+            munmap(buf_ring_, buf_ring_size_);
+        }
+
+        delete[] bufs_;
+
+        if (sqes_ != nullptr)
+        {
+            munmap(sqes_, sqes_map_size_);
+        }
+
+        if (cq_ptr_ != nullptr && cq_ptr_ != sq_ptr_)
+        {
+            munmap(cq_ptr_, cq_map_size_);
+        }
+
+        if (sq_ptr_ != nullptr)
+        {
+            munmap(sq_ptr_, sq_map_size_);
+        }
+
+        if (ring_fd_ >= 0)
+        {
+            close(ring_fd_);
+        }
+    }
+
+    bool IoUring::init(unsigned entries)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+
+        ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+
+        if (ring_fd_ < 0 && errno == EINVAL)
+        {
+            // Older kernel: retry without the optional flags
+            memset(&params, 0, sizeof(params));
+            ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        }
+
+        if (ring_fd_ < 0)
+        {
+            return false;
+        }
+
+        sq_map_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_map_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            if (cq_map_size_ > sq_map_size_)
+            {
+                sq_map_size_ = cq_map_size_;
+            }
+            cq_map_size_ = sq_map_size_;
+        }
+
+        sq_ptr_ = mmap(nullptr, sq_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED)
+        {
+            sq_ptr_ = nullptr;
+            return false;
+        }
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            cq_ptr_ = sq_ptr_;
+        }
+        else
+        {
+            cq_ptr_ = mmap(nullptr, cq_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+            if (cq_ptr_ == MAP_FAILED)
+            {
+                cq_ptr_ = nullptr;
+                return false;
+            }
+        }
+
+        sqes_map_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqes = mmap(nullptr, sqes_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+        {
+            return false;
+        }
+        sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+        char *sq = static_cast<char *>(sq_ptr_);
+        sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+
+        // SQE slot i always lives at array index i, so the indirection array is fixed once here
+        unsigned *array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        for (unsigned i = 0; i < sq_entries_; i++)
+        {
+            array[i] = i;
+        }
+
+        char *cq = static_cast<char *>(cq_ptr_);
+        cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+        sqe_tail_ = *sq_tail_;
+        sqe_submitted_ = sqe_tail_;
+        return true;
+    }
+
+    io_uring_sqe *IoUring::get_sqe()
+    {
+        unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+
+        if (sqe_tail_ - head >= sq_entries_)
+        {
+            return nullptr;
+        }
+
+        io_uring_sqe *sqe = &sqes_[sqe_tail_ & sq_mask_];
+        sqe_tail_++;
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    int IoUring::submit_and_wait(unsigned wait_nr)
+    {
+        unsigned to_submit = sqe_tail_ - sqe_submitted_;
+        __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+        sqe_submitted_ = sqe_tail_;
+
+        unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+        int ret = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, to_submit, wait_nr, flags, nullptr, 0));
+        return ret < 0 ? -errno : ret;
+    }
+
+    bool IoUring::register_buf_ring(uint16_t bgid, unsigned entries, size_t buf_size)
+    {
+        // entries must be a power of two for the ring mask
+        buf_ring_size_ = entries * sizeof(io_uring_buf);
+        void *ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring == MAP_FAILED)
+        {
+            return false;
+        }
+        buf_ring_ = static_cast<io_uring_buf_ring *>(ring);
+
+        io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+        reg.ring_entries = entries;
+        reg.bgid = bgid;
+
+        if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        {
+            munmap(buf_ring_, buf_ring_size_);
+            buf_ring_ = nullptr;
+            return false;
+        }
+
+        buf_entries_ = entries;
+        buf_size_ = buf_size;
+        bufs_ = new char[entries * buf_size];
+        buf_tail_ = 0;
+
+        for (unsigned bid = 0; bid < entries; bid++)
+        {
+            io_uring_buf *buf = ring_slot(static_cast<uint16_t>(buf_tail_ + bid));
+            buf->addr = reinterpret_cast<uint64_t>(buffer(static_cast<uint16_t>(bid)));
+            buf->len = static_cast<uint32_t>(buf_size);
+            buf->bid = static_cast<uint16_t>(bid);
+        }
+
+        buf_tail_ = static_cast<uint16_t>(buf_tail_ + entries);
+        __atomic_store_n(&buf_ring_->tail, buf_tail_, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    io_uring_buf *IoUring::ring_slot(uint16_t index) const
+    {
+        // Not &buf_ring_->bufs[i]: under C++ the header's __DECLARE_FLEX_ARRAY wraps an empty
+        // struct of size 1 in front of bufs, shifting it to offset 8. The slots start at 0.
+        return reinterpret_cast<io_uring_buf *>(buf_ring_) + (index & (buf_entries_ - 1));
+    }
+
+    void IoUring::recycle_buffer(uint16_t bid)
+    {
+        io_uring_buf *buf = ring_slot(buf_tail_);
+        buf->addr = reinterpret_cast<uint64_t>(buffer(bid));
+        buf->len = static_cast<uint32_t>(buf_size_);
+        buf->bid = bid;
+
+        buf_tail_++;
+        __atomic_store_n(&buf_ring_->tail, buf_tail_, __ATOMIC_RELEASE);
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <linux/io_uring.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace kv
+{
+    // Thin wrapper around the raw io_uring syscalls so we don't need liburing.
+    // Only what the server backend uses: SQE/CQE rings and one provided buffer ring.
+    class IoUring
+    {
+    public:
+        IoUring() = default;
+        ~IoUring();
+
+        IoUring(const IoUring &) = delete;
+        IoUring &operator=(const IoUring &) = delete;
+
+        // Returns false if the kernel doesn't support io_uring (or it is blocked)
+        bool init(unsigned entries);
+
+        // Returns nullptr when the submission queue is full
+        io_uring_sqe *get_sqe();
+
+        // Submits every queued SQE in one io_uring_enter and waits for wait_nr completions.
+        // Returns the number submitted or -errno.
+        int submit_and_wait(unsigned wait_nr);
+
+        // Calls fn(const io_uring_cqe&) for every ready completion, then advances the CQ head
+        template <typename Fn>
+        unsigned for_each_cqe(Fn &&fn)
+        {
+            unsigned head = *cq_head_;
+            unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            unsigned seen = 0;
+
+            while (head != tail)
+            {
+                fn(cqes_[head & cq_mask_]);
+                head++;
+                seen++;
+            }
+
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+            return seen;
+        }
+
+        // Provided buffers: the kernel picks a buffer from the group for each recv
+        bool register_buf_ring(uint16_t bgid, unsigned entries, size_t buf_size);
+        char *buffer(uint16_t bid) const { return bufs_ + static_cast<size_t>(bid) * buf_size_; }
+        void recycle_buffer(uint16_t bid);
+
+    private:
+        io_uring_buf *ring_slot(uint16_t index) const;
+
+        int ring_fd_ = -1;
+
+        void *sq_ptr_ = nullptr;
+        void *cq_ptr_ = nullptr;
+        size_t sq_map_size_ = 0;
+        size_t cq_map_size_ = 0;
+        io_uring_sqe *sqes_ = nullptr;
+        size_t sqes_map_size_ = 0;
+
+        unsigned *sq_head_ = nullptr;
+        unsigned *sq_tail_ = nullptr;
+        unsigned sq_mask_ = 0;
+        unsigned sq_entries_ = 0;
+        unsigned sqe_tail_ = 0;
+        unsigned sqe_submitted_ = 0;
+
+        unsigned *cq_head_ = nullptr;
+        unsigned *cq_tail_ = nullptr;
+        unsigned cq_mask_ = 0;
+        io_uring_cqe *cqes_ = nullptr;
+
+        io_uring_buf_ring *buf_ring_ = nullptr;
+        size_t buf_ring_size_ = 0;
+        unsigned buf_entries_ = 0;
+        uint16_t buf_tail_ = 0;
+        char *bufs_ = nullptr;
+        size_t buf_size_ = 0;
+    };
+}
@@ -0,0 +1,100 @@
+#include "output_buffer.h"
+#include <algorithm>
+#include <sys/socket.h>
+
+namespace kv
+{
+    namespace
+    {
+        constexpr size_t kMaxIovecs = 64;
+    }
+
+    void OutputBuffer::append(const std::string &data)
+    {
+        if (data.empty())
+        {
+            return;
+        }
+
+        if (segments_.empty() || segments_.back().shared || tail_sealed_)
+        {
+            segments_.emplace_back();
+            tail_sealed_ = false;
+        }
+
+        segments_.back().owned += data;
+        bytes_ += data.size();
+    }
+
+    void OutputBuffer::append_shared(std::shared_ptr<const std::string> data)
+    {
+        if (!data || data->empty())
+        {
+            return;
+        }
+
+        bytes_ += data->size();
+        segments_.emplace_back();
+        segments_.back().shared = std::move(data);
+    }
+
+    size_t OutputBuffer::prepare_iovecs(iovec *iov, size_t max)
+    {
+        size_t count = std::min(max, segments_.size());
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t skip = i == 0 ? front_offset_ : 0;
+            iov[i].iov_base = const_cast<char *>(segments_[i].data() + skip);
+            iov[i].iov_len = segments_[i].size() - skip;
+        }
+
+        tail_sealed_ = true;
+        return count;
+    }
+
+    void OutputBuffer::consume(size_t bytes)
+    {
+        bytes_ -= bytes;
+
+        while (bytes > 0)
+        {
+            size_t left = segments_.front().size() - front_offset_;
+            if (bytes < left)
+            {
+                front_offset_ += bytes;
+                return;
+            }
+
+            bytes -= left;
+            segments_.pop_front();
+            front_offset_ = 0;
+        }
+
+        if (segments_.empty())
+        {
+            tail_sealed_ = false;
+        }
+    }
+
+    bool OutputBuffer::flush(int sock)
+    {
+        iovec iov[kMaxIovecs];
+
+        while (!empty())
+        {
+            msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = prepare_iovecs(iov, kMaxIovecs);
+
+            ssize_t n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                return false;
+            }
+            consume(n);
+        }
+
+        tail_sealed_ = false;
+        return true;
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include <sys/uio.h>
+
+namespace kv {
+    // Pending reply bytes for one connection, as a list of segments.
+    // Ordinary replies are copied into an owned tail segment; shared segments (a pub/sub
+    // message fanned out to many subscribers) are referenced, not copied, and go out
+    // through the same writev/sendmsg as everything else.
+    class OutputBuffer {
+        public:
+            void append(const std::string &data);
+            void append_shared(std::shared_ptr<const std::string> data);
+
+            bool empty() const { return bytes_ == 0; }
+            size_t size() const { return bytes_; }
+
+            // Points up to max iovecs at the pending bytes, oldest first, and returns how many.
+            // Later appends go to a new segment so the iovecs stay valid until consume().
+            size_t prepare_iovecs(iovec *iov, size_t max);
+            void consume(size_t bytes);
+
+            // Blocking writev until everything is sent. False if the peer went away.
+            bool flush(int sock);
+
+        private:
+            struct Segment {
+                std::shared_ptr<const std::string> shared;
+                std::string owned;
+
+                const char *data() const { return shared ? shared->data() : owned.data(); }
+                size_t size() const { return shared ? shared->size() : owned.size(); }
+            };
+
+            std::deque<Segment> segments_;
+            size_t front_offset_ = 0; // bytes of the front segment already sent
+            size_t bytes_ = 0;
+            bool tail_sealed_ = false;
+    };
+}
@@ -0,0 +1,371 @@
+#include "tcp_server.h"
+#include <charconv>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+
+// Primary/replica replication.
+//
+// The primary records every effective mutation as an inline command line in backlog_.
+// A replica sends "PSYNC <replid> <offset>" and gets either
+//   +CONTINUE\r\n                                   (offset still in the backlog), or
+//   +FULLRESYNC <replid> <offset>\r\n$<len>\r\n<snapshot command lines>
+// followed by the raw command stream from that offset. Replaying the stream over a
+// snapshot taken after the offset was captured converges, because every logged command
+// overwrites a key or member instead of modifying it relative to its old value.
+// Replicas never expire keys themselves: they hide them once due, and the primary's
+// expiry arrives as a DELETE.
+
+namespace kv
+{
+    namespace
+    {
+        constexpr size_t kStreamChunk = 64 * 1024;
+
+        std::string to_command_line(const Mutation &m)
+        {
+            std::string key(m.key);
+            std::string value(m.value);
+
+            switch (m.type)
+            {
+            case Mutation::Type::Set:
+                if (m.ttl.count() > 0)
+                {
+                    return "SETEX " + key + " " + std::to_string(m.ttl.count()) + " " + value + "\n";
+                }
+                return "SET " + key + " " + value + "\n";
+            case Mutation::Type::Del:
+            case Mutation::Type::Expire:
+                return "DELETE " + key + "\n";
+            case Mutation::Type::ZAdd:
+                return "ZADD " + key + " " + format_score(m.score) + " " + value + "\n";
+            case Mutation::Type::ZRem:
+                return "ZREM " + key + " " + value + "\n";
+            case Mutation::Type::HSet:
+                return "HSET " + key + " " + std::string(m.field) + " " + value + "\n";
+            case Mutation::Type::HDel:
+                return "HDEL " + key + " " + std::string(m.field) + "\n";
+            case Mutation::Type::PfAdd:
+                return "PFADD " + key + " " + value + "\n";
+            case Mutation::Type::BfAdd:
+                return "BF.ADD " + key + " " + value + "\n";
+            case Mutation::Type::Restore:
+                return "RESTORE " + key + " " + encode_hex(m.value) + "\n";
+            }
+            return "";
+        }
+
+        // Snapshot command lines, with each sorted set's members (reported consecutively)
+        // batched into one ZADD so the replica bulk-builds the set
+        class SnapshotWriter
+        {
+        public:
+            explicit SnapshotWriter(std::string &out) : out_(out) {}
+
+            void add(const Mutation &m)
+            {
+                if (m.type != Mutation::Type::ZAdd)
+                {
+                    finish();
+                    out_ += to_command_line(m);
+                    return;
+                }
+
+                if (!open_ || zset_key_ != m.key)
+                {
+                    finish();
+                    zset_key_ = m.key;
+                    out_ += "ZADD " + zset_key_;
+                    open_ = true;
+                }
+                out_ += " " + format_score(m.score) + " " + std::string(m.value);
+            }
+
+            void finish()
+            {
+                if (open_)
+                {
+                    out_ += "\n";
+                    open_ = false;
+                }
+            }
+
+        private:
+            std::string &out_;
+            std::string zset_key_;
+            bool open_ = false;
+        };
+
+        bool read_line(int sock, std::string &buf, std::string &line)
+        {
+            size_t pos;
+            while ((pos = buf.find('\n')) == std::string::npos)
+            {
+                char tmp[4096];
+                ssize_t n = recv(sock, tmp, sizeof(tmp), 0);
+                if (n <= 0)
+                {
+                    return false;
+                }
+                buf.append(tmp, n);
+            }
+
+            line = buf.substr(0, pos);
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            buf.erase(0, pos + 1);
+            return true;
+        }
+
+        bool read_exact(int sock, std::string &buf, size_t len, std::string &out)
+        {
+            while (buf.size() < len)
+            {
+                char tmp[kStreamChunk];
+                ssize_t n = recv(sock, tmp, sizeof(tmp), 0);
+                if (n <= 0)
+                {
+                    return false;
+                }
+                buf.append(tmp, n);
+            }
+
+            out = buf.substr(0, len);
+            buf.erase(0, len);
+            return true;
+        }
+
+        int connect_to(const std::string &host, int port)
+        {
+            addrinfo hints;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_INET;
+            hints.ai_socktype = SOCK_STREAM;
+
+            addrinfo *res = nullptr;
+            if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0)
+            {
+                return -1;
+            }
+
+            int sock = -1;
+            for (addrinfo *ai = res; ai != nullptr; ai = ai->ai_next)
+            {
+                sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+                if (sock < 0)
+                {
+                    continue;
+                }
+                if (connect(sock, ai->ai_addr, ai->ai_addrlen) == 0)
+                {
+                    break;
+                }
+                close(sock);
+                sock = -1;
+            }
+
+            freeaddrinfo(res);
+            return sock;
+        }
+    }
+
+    std::string TCPServer::new_replid()
+    {
+        static const char hex[] = "0123456789abcdef";
+        std::mt19937_64 rng(std::random_device{}());
+        std::string id(40, '0');
+        for (auto &c : id)
+        {
+            c = hex[rng() % 16];
+        }
+        return id;
+    }
+
+    void TCPServer::set_replica_of(const std::string &host, int port)
+    {
+        primary_host_ = host;
+        primary_port_ = port;
+    }
+
+    void TCPServer::record_mutation(const Mutation &m)
+    {
+        // Runs under the shard write lock; the backlog only starts recording once a replica exists
+        if (backlog_.enabled())
+        {
+            backlog_.append(to_command_line(m));
+        }
+
+        if (m.type == Mutation::Type::ZAdd)
+        {
+            waiters_.signal(m.key);
+        }
+    }
+
+    void TCPServer::serve_replica(int sock, const ClientSession &session)
+    {
+        uint64_t offset;
+
+        if (session.psync_replid == replid_ && backlog_.enabled() && backlog_.contains(session.psync_offset))
+        {
+            offset = session.psync_offset;
+            if (!send_all(sock, "+CONTINUE\r\n"))
+            {
+                return;
+            }
+            std::cout << "Replica resumed at offset " << offset << std::endl;
+        }
+        else
+        {
+            // Capture the offset before the snapshot so nothing between the two is lost
+            backlog_.enable();
+            offset = backlog_.end_offset();
+
+            std::string payload;
+            SnapshotWriter writer(payload);
+            store_.snapshot([&writer](const Mutation &m) { writer.add(m); });
+            writer.finish();
+
+            std::string header = "+FULLRESYNC " + replid_ + " " + std::to_string(offset) + "\r\n$" + std::to_string(payload.size()) + "\r\n";
+            if (!send_all(sock, header) || !send_all(sock, payload))
+            {
+                return;
+            }
+            std::cout << "Replica full resync at offset " << offset << " (" << payload.size() << " bytes)" << std::endl;
+        }
+
+        std::string chunk;
+        while (running_)
+        {
+            if (!backlog_.read(offset, chunk, kStreamChunk, std::chrono::milliseconds(1000)))
+            {
+                std::cerr << "Replica fell out of the backlog window, dropping it" << std::endl;
+                break;
+            }
+
+            if (!chunk.empty())
+            {
+                if (!send_all(sock, chunk))
+                {
+                    break;
+                }
+                offset += chunk.size();
+            }
+        }
+
+        std::cout << "Replica disconnected." << std::endl;
+    }
+
+    void TCPServer::replica_loop()
+    {
+        while (running_)
+        {
+            int sock = connect_to(primary_host_, primary_port_);
+
+            if (sock >= 0)
+            {
+                primary_sock_ = sock;
+                std::cout << "Connected to primary " << primary_host_ << ":" << primary_port_ << std::endl;
+                sync_with_primary(sock);
+                primary_sock_ = -1;
+                close(sock);
+            }
+
+            if (running_)
+            {
+                std::cerr << "Lost primary " << primary_host_ << ":" << primary_port_ << ", retrying" << std::endl;
+            }
+
+            for (int i = 0; i < 10 && running_; i++)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        }
+    }
+
+    bool TCPServer::sync_with_primary(int sock)
+    {
+        std::string request = "PSYNC " + (primary_replid_.empty() ? std::string("?") : primary_replid_) + " " + std::to_string(primary_offset_) + "\n";
+        if (!send_all(sock, request))
+        {
+            return false;
+        }
+
+        std::string buf;
+        std::string line;
+        OutputBuffer ignored;
+        ClientSession link;
+        link.from_primary = true;
+
+        if (!read_line(sock, buf, line))
+        {
+            return false;
+        }
+
+        if (line.rfind("+FULLRESYNC ", 0) == 0)
+        {
+            char id[64] = {0};
+            unsigned long long offset = 0;
+            if (sscanf(line.c_str(), "+FULLRESYNC %63s %llu", id, &offset) != 2)
+            {
+                return false;
+            }
+
+            // A malformed size line drops the link, and replica_loop reconnects
+            std::string size_line;
+            std::string payload;
+            size_t size = 0;
+            if (!read_line(sock, buf, size_line) || size_line.size() < 2 || size_line[0] != '$')
+            {
+                return false;
+            }
+            auto [end, ec] = std::from_chars(size_line.data() + 1, size_line.data() + size_line.size(), size);
+            if (ec != std::errc() || end != size_line.data() + size_line.size() || !read_exact(sock, buf, size, payload))
+            {
+                return false;
+            }
+
+            store_.clear();
+            consume_input(payload, ignored, link);
+
+            primary_replid_ = id;
+            primary_offset_ = offset;
+            std::cout << "Full resync from primary done at offset " << offset << std::endl;
+        }
+        else if (line == "+CONTINUE")
+        {
+            std::cout << "Partial resync from primary at offset " << primary_offset_ << std::endl;
+        }
+        else
+        {
+            std::cerr << "Unexpected PSYNC reply: " << line << std::endl;
+            return false;
+        }
+
+        // Tail the command stream; the offset only advances past complete commands
+        char recv_buffer[kStreamChunk];
+        while (running_)
+        {
+            size_t before = buf.size();
+            consume_input(buf, ignored, link);
+            primary_offset_ += before - buf.size();
+            ignored.consume(ignored.size());
+
+            ssize_t n = recv(sock, recv_buffer, sizeof(recv_buffer), 0);
+            if (n <= 0)
+            {
+                return false;
+            }
+            buf.append(recv_buffer, n);
+        }
+        return true;
+    }
+}
@@ -0,0 +1,270 @@
+#include "resp.h"
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+
+namespace kv
+{
+    std::string encode_simple_string(const std::string &str)
+    {
+        return "+" + str + "\r\n";
+    }
+
+    std::string encode_error(const std::string &err)
+    {
+        return "-ERR " + err + "\r\n";
+    }
+
+    std::string encode_integer(long long val)
+    {
+        return ":" + std::to_string(val) + "\r\n";
+    }
+
+    std::string encode_bulk_string(std::string_view str)
+    {
+        std::string length = std::to_string(str.size());
+        std::string res;
+        res.reserve(length.size() + str.size() + 5);
+        res += '$';
+        res += length;
+        res += "\r\n";
+        res.append(str);
+        res += "\r\n";
+        return res;
+    }
+
+    std::string encode_null_bulk_string()
+    {
+        return "$-1\r\n";
+    }
+
+    std::string encode_array(const std::vector<std::string> &elements)
+    {
+        std::string res = "*" + std::to_string(elements.size()) + "\r\n";
+
+        for (const auto &el : elements)
+        {
+            res += encode_bulk_string(el);
+        }
+
+        return res;
+    }
+
+    std::string format_score(double score)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.17g", score);
+        return buf;
+    }
+
+    std::string encode_hex(std::string_view bytes)
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(bytes.size() * 2);
+        for (unsigned char c : bytes)
+        {
+            hex.push_back(digits[c >> 4]);
+            hex.push_back(digits[c & 0xf]);
+        }
+        return hex;
+    }
+
+    std::optional<std::string> decode_hex(std::string_view hex)
+    {
+        auto nibble = [](char c) -> int {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        };
+
+        if (hex.size() % 2 != 0)
+        {
+            return std::nullopt;
+        }
+
+        std::string bytes;
+        bytes.reserve(hex.size() / 2);
+        for (size_t i = 0; i < hex.size(); i += 2)
+        {
+            int hi = nibble(hex[i]);
+            int lo = nibble(hex[i + 1]);
+            if (hi < 0 || lo < 0)
+            {
+                return std::nullopt;
+            }
+            bytes.push_back(static_cast<char>(hi << 4 | lo));
+        }
+        return bytes;
+    }
+
+    void split_command(std::string_view line, ArenaVector<std::string> &args)
+    {
+        auto is_space = [](char c) { return std::isspace(static_cast<unsigned char>(c)) != 0; };
+
+        // Count first so the arena hands out exactly one array
+        size_t count = 0;
+        for (size_t i = 0; i < line.size(); i++)
+        {
+            if (!is_space(line[i]) && (i == 0 || is_space(line[i - 1])))
+            {
+                count++;
+            }
+        }
+        args.reserve(args.size() + count);
+
+        size_t i = 0;
+        while (i < line.size())
+        {
+            while (i < line.size() && is_space(line[i]))
+            {
+                i++;
+            }
+            size_t begin = i;
+            while (i < line.size() && !is_space(line[i]))
+            {
+                i++;
+            }
+            if (i > begin)
+            {
+                args.emplace_back(line.data() + begin, i - begin);
+            }
+        }
+    }
+
+    namespace
+    {
+        // The line starting at pos without its CRLF, advancing pos past it; false if incomplete
+        bool take_line(std::string_view buf, size_t &pos, std::string_view &line)
+        {
+            size_t end = buf.find("\r\n", pos);
+            if (end == std::string_view::npos)
+            {
+                return false;
+            }
+            line = buf.substr(pos, end - pos);
+            pos = end + 2;
+            return true;
+        }
+
+        long long parse_length(std::string_view text)
+        {
+            long long value = 0;
+            auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+            if (ec != std::errc() || end != text.data() + text.size())
+            {
+                throw ProtocolError("bad number in reply: " + std::string(text));
+            }
+            return value;
+        }
+
+        bool parse_at(std::string_view buf, size_t &pos, Reply &reply)
+        {
+            std::string_view line;
+            if (!take_line(buf, pos, line))
+            {
+                return false;
+            }
+            if (line.empty())
+            {
+                throw ProtocolError("empty reply line");
+            }
+
+            std::string_view body = line.substr(1);
+            switch (line[0])
+            {
+            case '+':
+                reply.type = Reply::Type::Status;
+                reply.str = body;
+                return true;
+            case '-':
+                reply.type = Reply::Type::Error;
+                reply.str = body;
+                return true;
+            case ':':
+                reply.type = Reply::Type::Integer;
+                reply.integer = parse_length(body);
+                return true;
+            case '$':
+            {
+                long long len = parse_length(body);
+                if (len < 0)
+                {
+                    reply.type = Reply::Type::Null;
+                    return true;
+                }
+                if (buf.size() - pos < static_cast<size_t>(len) + 2)
+                {
+                    return false;
+                }
+                if (buf.compare(pos + len, 2, "\r\n") != 0)
+                {
+                    throw ProtocolError("bulk string not followed by CRLF");
+                }
+                reply.type = Reply::Type::Bulk;
+                reply.str = buf.substr(pos, len);
+                pos += len + 2;
+                return true;
+            }
+            case '*':
+            {
+                long long count = parse_length(body);
+                if (count < 0)
+                {
+                    reply.type = Reply::Type::Null;
+                    return true;
+                }
+                reply.type = Reply::Type::Array;
+                reply.elements.clear();
+                for (long long i = 0; i < count; i++)
+                {
+                    reply.elements.emplace_back();
+                    if (!parse_at(buf, pos, reply.elements.back()))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+            default:
+                throw ProtocolError("unknown reply type '" + std::string(1, line[0]) + "'");
+            }
+        }
+    }
+
+    size_t parse_reply(std::string_view buf, Reply &reply)
+    {
+        size_t pos = 0;
+        return parse_at(buf, pos, reply) ? pos : 0;
+    }
+
+    std::string encode_command(const std::vector<std::string> &args)
+    {
+        std::string line;
+        for (const auto &arg : args)
+        {
+            if (arg.empty())
+            {
+                throw std::invalid_argument("empty command argument");
+            }
+            for (char c : arg)
+            {
+                if (std::isspace(static_cast<unsigned char>(c)))
+                {
+                    throw std::invalid_argument("command argument with whitespace: " + arg);
+                }
+            }
+            if (!line.empty())
+            {
+                line += ' ';
+            }
+            line += arg;
+        }
+        if (line.empty())
+        {
+            throw std::invalid_argument("empty command");
+        }
+        return line + "\r\n";
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "arena.h"
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kv {
+    // RESP reply encoders shared by the server and anything else that builds replies
+    std::string encode_simple_string(const std::string &str);
+    std::string encode_error(const std::string &err);
+    std::string encode_integer(long long val);
+    std::string encode_bulk_string(std::string_view str);
+    std::string encode_null_bulk_string();
+    std::string encode_array(const std::vector<std::string> &elements);
+
+    // Shortest-safe text for a score: "%.17g" round-trips exactly through stod
+    std::string format_score(double score);
+
+    // Lowercase hex, so binary values (RESTORE payloads) fit on an inline command line.
+    // decode_hex returns nullopt on odd length or a non-hex digit.
+    std::string encode_hex(std::string_view bytes);
+    std::optional<std::string> decode_hex(std::string_view hex);
+
+    // Splits an inline command line on whitespace into args. The vector comes from the arena
+    // and arguments up to std::string's small-buffer size live inside it, so a typical
+    // command is parsed without touching malloc.
+    void split_command(std::string_view line, ArenaVector<std::string> &args);
+
+    // Client side of the protocol
+
+    struct ProtocolError : std::runtime_error
+    {
+        using std::runtime_error::runtime_error;
+    };
+
+    // One parsed reply. A null bulk string or array is Null.
+    struct Reply
+    {
+        enum class Type { Status, Error, Integer, Bulk, Array, Null };
+
+        Type type = Type::Null;
+        std::string str;             // Status, Error (without the '-') and Bulk
+        long long integer = 0;
+        std::vector<Reply> elements; // Array
+
+        bool is_error() const { return type == Type::Error; }
+
+        static Reply error(std::string message)
+        {
+            Reply reply;
+            reply.type = Type::Error;
+            reply.str = std::move(message);
+            return reply;
+        }
+    };
+
+    // Parses the reply at the front of buf into reply. Returns the bytes it took, or 0 if buf
+    // doesn't hold a whole reply yet. Throws ProtocolError on anything that isn't RESP.
+    size_t parse_reply(std::string_view buf, Reply &reply);
+
+    // The inline command line for args, "SET key value\r\n". Throws std::invalid_argument for an
+    // empty argument or one with whitespace, which the line protocol can't carry.
+    std::string encode_command(const std::vector<std::string> &args);
+}
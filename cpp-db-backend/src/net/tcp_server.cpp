@@ -5,65 +5,398 @@
 #include <string>
 #include <thread>
 #include <unistd.h>
+#include <poll.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <stdexcept>
 #include <sstream>
 #include <vector>
+#include <cstdint>
+#include <unordered_set>
 
 namespace kv
 {
+    namespace
+    {
+        // Parsed arguments of the command being run on this thread (see consume_input)
+        thread_local Arena request_arena;
+
+        // Output of the connection whose command is being run on this thread, where GET
+        // queues large values by reference. Null inside transactions, whose replies are
+        // concatenated into one string.
+        thread_local OutputBuffer *direct_reply = nullptr;
+
+        struct DirectReplyScope
+        {
+            explicit DirectReplyScope(OutputBuffer *out) : saved(direct_reply) { direct_reply = out; }
+            ~DirectReplyScope() { direct_reply = saved; }
+            OutputBuffer *saved;
+        };
+
+        // Keeps one BF.RESERVE from claiming gigabytes (about 160 MB at a 1% error rate)
+        constexpr unsigned long long kMaxBloomCapacity = 1ULL << 27;
+
+        // Blocking pop timeouts past this (about 31 years) wait forever, which also keeps the
+        // deadline inside steady_clock's range
+        constexpr double kMaxBlockSeconds = 1e9;
+
+        // Commands a replica refuses from ordinary clients
+        bool is_write_command(const std::string &command)
+        {
+            static const std::unordered_set<std::string> writes = {"SET", "SETEX", "DELETE", "ZADD", "ZREM", "ZPOPMIN", "ZPOPMAX", "BZPOPMIN", "BZPOPMAX", "ZUNIONSTORE", "ZINTERSTORE", "HSET", "HDEL", "HINCRBY", "PFADD", "PFMERGE", "BF.RESERVE", "BF.ADD", "BF.MADD", "RESTORE"};
+            return writes.count(command) > 0;
+        }
+
+        // Lexicographic bound as in ZRANGEBYLEX: "[key" inclusive, "(key" exclusive.
+        // open ("-" or "+") means unbounded on that side.
+        bool parse_lex_bound(const std::string &token, const char *open, std::string &key, bool &exclusive, bool &unbounded)
+        {
+            unbounded = token == open;
+            if (unbounded)
+            {
+                return true;
+            }
+            if (token.size() < 2 || (token[0] != '[' && token[0] != '('))
+            {
+                return false;
+            }
+            exclusive = token[0] == '(';
+            key = token.substr(1);
+            return true;
+        }
+
+        // One integer (0/1) per item
+        std::string encode_flags(const std::vector<bool> &flags)
+        {
+            std::string res = "*" + std::to_string(flags.size()) + "\r\n";
+            for (bool flag : flags)
+            {
+                res += encode_integer(flag ? 1 : 0);
+            }
+            return res;
+        }
+
+        // [kind, name, count]; name is null for an UNSUBSCRIBE with nothing to drop
+        std::string subscription_reply(const std::string &kind, const std::string *name, size_t count)
+        {
+            return "*3\r\n" + encode_bulk_string(kind) + (name ? encode_bulk_string(*name) : encode_null_bulk_string()) + encode_integer(count);
+        }
+
+        // [seq, op, key, ...]: the member/field, then the value or score where the op has one
+        std::string encode_change(const ChangeEvent &e)
+        {
+            static const char *ops[] = {"set", "del", "zadd", "zrem", "hset", "hdel", "expire", "pfadd", "bfadd", "restore"};
+            std::vector<std::string> args = {ops[static_cast<int>(e.type)], e.key};
+
+            switch (e.type)
+            {
+            case Mutation::Type::Set:
+                args.push_back(e.value);
+                break;
+            case Mutation::Type::ZAdd:
+                args.push_back(e.value);
+                args.push_back(format_score(e.score));
+                break;
+            case Mutation::Type::ZRem:
+                args.push_back(e.value);
+                break;
+            case Mutation::Type::HSet:
+                args.push_back(e.field);
+                args.push_back(e.value);
+                break;
+            case Mutation::Type::HDel:
+                args.push_back(e.field);
+                break;
+            case Mutation::Type::PfAdd:
+            case Mutation::Type::BfAdd:
+            case Mutation::Type::Restore:
+                args.push_back(e.value);
+                break;
+            default:
+                break;
+            }
+
+            std::string res = "*" + std::to_string(args.size() + 1) + "\r\n" + encode_integer(e.seq);
+            for (const auto &arg : args)
+            {
+                res += encode_bulk_string(arg);
+            }
+            return res;
+        }
+    }
+
+    // send() may write less than asked for on big pipelined replies
+    bool send_all(int sock, const std::string &data)
+    {
+        size_t sent = 0;
+        while (sent < data.size())
+        {
+            ssize_t n = send(sock, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                return false;
+            }
+            sent += n;
+        }
+        return true;
+    }
 
-    TCPServer::TCPServer(int port, int num_shards) : port_(port), store_(num_shards), server_sock_(-1), running_(false)
+    TCPServer::TCPServer(int port, int num_shards, Backend backend) : store_(num_shards), port_(port), running_(false), backend_(backend), wake_fd_(-1), replid_(new_replid())
     {
-        server_sock_ = socket(AF_INET, SOCK_STREAM, 0);
-        if (server_sock_ < 0)
+        store_.set_write_observer([this](const Mutation &m) { record_mutation(m); });
+    }
+
+    void TCPServer::set_listen_options(const ListenOptions &options)
+    {
+        listen_options_ = options;
+    }
+
+    int TCPServer::open_listener(int family, bool reuse_port)
+    {
+        int sock = socket(family, SOCK_STREAM, 0);
+        if (sock < 0)
         {
             throw std::runtime_error("Failed to create socket");
         }
 
-        // Now bind the socket to the port
+        int one = 1;
+        if (family == AF_INET)
+        {
+            // Restarts can rebind while old connections sit in TIME_WAIT
+            setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (reuse_port && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0)
+            {
+                close(sock);
+                throw std::runtime_error("SO_REUSEPORT is not supported");
+            }
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
 
-        struct sockaddr_in server_addr;
-        memset(&server_addr, 0, sizeof(server_addr));
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_addr.s_addr = INADDR_ANY;
-        server_addr.sin_port = htons(port_);
+        // Set before listen() so the TCP window scale is negotiated for the larger buffer
+        if (listen_options_.send_buffer > 0)
+        {
+            setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &listen_options_.send_buffer, sizeof(listen_options_.send_buffer));
+        }
+        if (listen_options_.recv_buffer > 0)
+        {
+            setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &listen_options_.recv_buffer, sizeof(listen_options_.recv_buffer));
+        }
 
-        if (bind(server_sock_, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+        int bound;
+        if (family == AF_INET)
         {
-            close(server_sock_);
-            throw std::runtime_error("Failed to bind socket");
+            struct sockaddr_in server_addr;
+            memset(&server_addr, 0, sizeof(server_addr));
+            server_addr.sin_family = AF_INET;
+            server_addr.sin_addr.s_addr = INADDR_ANY;
+            server_addr.sin_port = htons(port_);
+            bound = bind(sock, (struct sockaddr *)&server_addr, sizeof(server_addr));
+        }
+        else
+        {
+            struct sockaddr_un server_addr;
+            memset(&server_addr, 0, sizeof(server_addr));
+            server_addr.sun_family = AF_UNIX;
+            if (listen_options_.unix_path.size() >= sizeof(server_addr.sun_path))
+            {
+                close(sock);
+                throw std::runtime_error("Unix socket path is too long");
+            }
+            strcpy(server_addr.sun_path, listen_options_.unix_path.c_str());
+            unlink(server_addr.sun_path); // left behind by a previous run
+            bound = bind(sock, (struct sockaddr *)&server_addr, sizeof(server_addr));
         }
 
-        // Now listen for incoming connections
+        if (bound < 0)
+        {
+            close(sock);
+            throw std::runtime_error("Failed to bind socket");
+        }
 
-        if (listen(server_sock_, SOMAXCONN) < 0)
+        if (listen(sock, SOMAXCONN) < 0)
         {
-            close(server_sock_);
+            close(sock);
             throw std::runtime_error("Failed to listen on socket");
         }
-        std::cout << "Server listening on port " << port_ << std::endl;
+        return sock;
     }
 
-    std::string TCPServer::process_command(const std::string &cmd)
+    void TCPServer::open_listeners()
     {
-        std::istringstream iss(cmd);
-        std::string token;
-        std::vector<std::string> tokens;
+        // The io_uring loop is a single thread, so it only needs one TCP listener
+        int acceptors = backend_ == Backend::IoUring ? 1 : std::max(1, listen_options_.acceptors);
+        for (int i = 0; i < acceptors; i++)
+        {
+            listeners_.push_back({open_listener(AF_INET, acceptors > 1), true});
+        }
+        std::cout << "Server listening on port " << port_;
+        if (acceptors > 1)
+        {
+            std::cout << " (" << acceptors << " SO_REUSEPORT listeners)";
+        }
+        std::cout << std::endl;
 
-        while (iss >> token)
+        if (!listen_options_.unix_path.empty())
         {
-            tokens.push_back(token);
+            listeners_.push_back({open_listener(AF_UNIX, false), false});
+            std::cout << "Server listening on " << listen_options_.unix_path << std::endl;
         }
+    }
+
+    std::string TCPServer::process_command(std::string_view cmd, ClientSession &session)
+    {
+        ArenaVector<std::string> tokens(request_arena);
+        split_command(cmd, tokens);
 
         if (tokens.empty())
         {
             return encode_error("Empty command");
         }
 
-        std::string command = tokens[0];
+        const std::string &command = tokens[0];
+
+        if (command == "MULTI")
+        {
+            if (session.in_multi)
+            {
+                return encode_error("MULTI calls can not be nested");
+            }
+
+            session.in_multi = true;
+            session.queued.clear();
+            return encode_simple_string("OK");
+        }
+        else if (command == "DISCARD")
+        {
+            if (!session.in_multi)
+            {
+                return encode_error("DISCARD without MULTI");
+            }
+
+            session.in_multi = false;
+            session.queued.clear();
+            return encode_simple_string("OK");
+        }
+        else if (command == "EXEC")
+        {
+            if (!session.in_multi)
+            {
+                return encode_error("EXEC without MULTI");
+            }
+
+            return exec_transaction(session);
+        }
+        else if (session.in_multi)
+        {
+            if (command == "PSYNC" || command == "BZPOPMIN" || command == "BZPOPMAX" || command == "RESHARD")
+            {
+                return encode_error(command + " is not allowed inside MULTI");
+            }
+
+            // Queued commands outlive the arena
+            session.queued.emplace_back(std::make_move_iterator(tokens.begin()), std::make_move_iterator(tokens.end()));
+            return encode_simple_string("QUEUED");
+        }
+
+        return execute_command(tokens, session);
+    }
+
+    std::string TCPServer::exec_transaction(ClientSession &session)
+    {
+        std::vector<std::vector<std::string>> queued;
+        queued.swap(session.queued);
+        session.in_multi = false;
+
+        std::vector<std::string> keys;
+        bool all_shards = false;
+        for (const auto &tokens : queued)
+        {
+            all_shards |= !collect_keys(tokens, keys);
+        }
+
+        // One critical section for the whole batch, replies encoded into one buffer
+        DirectReplyScope no_direct_reply(nullptr);
+        std::string response = "*" + std::to_string(queued.size()) + "\r\n";
+        auto run = [&]() {
+            for (const auto &tokens : queued)
+            {
+                response += execute_command(tokens, session);
+            }
+        };
+
+        if (all_shards)
+        {
+            store_.atomically_all(run);
+        }
+        else
+        {
+            store_.atomically(keys, run);
+        }
+
+        return response;
+    }
+
+    bool TCPServer::collect_keys(const CommandArgs &tokens, std::vector<std::string> &keys)
+    {
+        if (tokens[0] == "ALL" || tokens[0] == "KEYS" || tokens[0] == "SCAN")
+        {
+            return false;
+        }
+
+        // ZUNIONSTORE/ZINTERSTORE dest numkeys key...
+        if ((tokens[0] == "ZUNIONSTORE" || tokens[0] == "ZINTERSTORE") && tokens.size() > 3)
+        {
+            keys.push_back(tokens[1]);
+            // Never more than the arguments given, so 3 + numkeys can't wrap
+            size_t numkeys = std::min<size_t>(strtoull(tokens[2].c_str(), nullptr, 10), tokens.size() - 3);
+            for (size_t i = 3; i < 3 + numkeys; i++)
+            {
+                keys.push_back(tokens[i]);
+            }
+            return true;
+        }
+
+        // PFCOUNT key [key ...], PFMERGE dest [src ...]
+        if (tokens[0] == "PFCOUNT" || tokens[0] == "PFMERGE")
+        {
+            keys.insert(keys.end(), tokens.begin() + 1, tokens.end());
+            return true;
+        }
+
+        // Every other command names its single key first
+        if (tokens.size() > 1)
+        {
+            keys.push_back(tokens[1]);
+        }
+        return true;
+    }
+
+    std::string TCPServer::execute_command(const CommandArgs &tokens, ClientSession &session)
+    {
+        try
+        {
+            return dispatch_command(tokens, session);
+        }
+        catch (const WrongTypeError &e)
+        {
+            return "-" + std::string(e.what()) + "\r\n";
+        }
+    }
+
+    std::string TCPServer::dispatch_command(const CommandArgs &tokens, ClientSession &session)
+    {
+        const std::string &command = tokens[0];
+
+        if (!primary_host_.empty() && !session.from_primary && is_write_command(command))
+        {
+            return encode_error("READONLY You can't write against a read only replica");
+        }
 
         if (command == "SET")
         {
@@ -75,6 +408,40 @@ namespace kv
             store_.set(tokens[1], tokens[2]);
             return encode_simple_string("OK");
         }
+        else if (command == "SETEX")
+        {
+            if (tokens.size() != 4)
+            {
+                return encode_error("SETEX command requires 3 arguments");
+            }
+
+            long long seconds;
+            try
+            {
+                seconds = std::stoll(tokens[2]);
+            }
+            catch (const std::exception &)
+            {
+                return encode_error("Expire time must be a valid integer");
+            }
+
+            if (seconds <= 0)
+            {
+                return encode_error("Expire time must be positive");
+            }
+
+            store_.setWithTTL(tokens[1], tokens[3], std::chrono::seconds(seconds));
+            return encode_simple_string("OK");
+        }
+        else if (command == "TTL")
+        {
+            if (tokens.size() != 2)
+            {
+                return encode_error("TTL command requires 1 argument");
+            }
+
+            return encode_integer(store_.ttl(tokens[1]));
+        }
         else if (command == "GET")
         {
             if (tokens.size() != 2)
@@ -82,15 +449,31 @@ namespace kv
                 return encode_error("GET command requires 1 argument");
             }
 
-            auto value = store_.get(tokens[1]);
-            if (value)
+            // A small value is encoded straight from the store. A large one is only referenced
+            // under the lock and goes out of its stored buffer, so the reply is just the framing.
+            std::string reply;
+            std::shared_ptr<const std::string> large;
+            bool found = store_.read_value(tokens[1], [&](std::string_view value, const std::shared_ptr<const std::string> &shared) {
+                if (direct_reply && shared && value.size() >= StringValue::kSharedFrom)
+                {
+                    large = shared;
+                }
+                else
+                {
+                    reply = encode_bulk_string(value);
+                }
+            });
+            if (!found)
             {
-                return encode_bulk_string(*value);
+                return encode_null_bulk_string();
             }
-            else
+            if (large)
             {
-                return encode_null_bulk_string();
+                direct_reply->append("$" + std::to_string(large->size()) + "\r\n");
+                direct_reply->append_shared(std::move(large));
+                direct_reply->append("\r\n");
             }
+            return reply;
         }
         else if (command == "DELETE")
         {
@@ -119,6 +502,15 @@ namespace kv
             bool exists = store_.exists(tokens[1]);
             return exists ? encode_integer(1) : encode_integer(0);
         }
+        else if (command == "TYPE")
+        {
+            if (tokens.size() != 2)
+            {
+                return encode_error("TYPE command requires 1 argument");
+            }
+
+            return encode_simple_string(store_.type(tokens[1]));
+        }
         else if (command == "ALL")
         {
             if (tokens.size() != 1)
@@ -143,28 +535,154 @@ namespace kv
 
             return encode_array(elements);
         }
+        else if (command == "KEYS")
+        {
+            if (tokens.size() > 2)
+            {
+                return encode_error("KEYS command takes an optional prefix");
+            }
+            if (!store_.key_index_enabled())
+            {
+                return encode_error("Key index is disabled, start the server with --key-index");
+            }
+
+            // A trailing * is accepted and ignored: the argument is always a plain prefix
+            KeyRange range;
+            if (tokens.size() == 2)
+            {
+                range.prefix = tokens[1];
+                if (!range.prefix.empty() && range.prefix.back() == '*')
+                {
+                    range.prefix.pop_back();
+                }
+            }
+            return encode_array(store_.scan_keys(range, SIZE_MAX));
+        }
+        else if (command == "SCAN")
+        {
+            // SCAN cursor [PREFIX prefix] [TO max] [COUNT count]
+            if (tokens.size() < 2 || tokens.size() % 2 != 0)
+            {
+                return encode_error("SCAN command requires a cursor and optional PREFIX, TO and COUNT arguments");
+            }
+            if (!store_.key_index_enabled())
+            {
+                return encode_error("Key index is disabled, start the server with --key-index");
+            }
+
+            KeyRange range;
+            bool unbounded;
+            if (!parse_lex_bound(tokens[1], "-", range.min, range.min_exclusive, unbounded))
+            {
+                return encode_error("Cursor must be -, [key or (key");
+            }
+
+            size_t count = 10;
+            for (size_t i = 2; i < tokens.size(); i += 2)
+            {
+                const std::string &option = tokens[i];
+                if (option == "PREFIX")
+                {
+                    range.prefix = tokens[i + 1];
+                }
+                else if (option == "TO")
+                {
+                    std::string max;
+                    bool max_exclusive = false;
+                    if (!parse_lex_bound(tokens[i + 1], "+", max, max_exclusive, unbounded))
+                    {
+                        return encode_error("TO must be +, [key or (key");
+                    }
+                    range.max = unbounded ? std::nullopt : std::optional<std::string>(max);
+                    range.max_exclusive = max_exclusive;
+                }
+                else if (option == "COUNT")
+                {
+                    try
+                    {
+                        count = std::stoull(tokens[i + 1]);
+                    }
+                    catch (const std::exception &)
+                    {
+                        return encode_error("Count must be a valid integer");
+                    }
+                    if (count == 0)
+                    {
+                        return encode_error("Count must be positive");
+                    }
+                }
+                else
+                {
+                    return encode_error("Unknown SCAN option " + option);
+                }
+            }
+
+            // [next cursor, [keys...]]; the cursor is + once the range is exhausted
+            auto keys = store_.scan_keys(range, count);
+            std::string next = keys.size() == count ? "(" + keys.back() : "+";
+            return "*2\r\n" + encode_bulk_string(next) + encode_array(keys);
+        }
         else if (command == "ZADD")
         {
-            if (tokens.size() != 4)
+            // key [NX|XX] [GT|LT] [CH] score member [score member ...]
+            ZAddOptions options;
+            size_t first = 2;
+            for (; first < tokens.size(); first++)
+            {
+                const std::string &flag = tokens[first];
+                if (flag == "NX")
+                {
+                    options.nx = true;
+                }
+                else if (flag == "XX")
+                {
+                    options.xx = true;
+                }
+                else if (flag == "GT")
+                {
+                    options.gt = true;
+                }
+                else if (flag == "LT")
+                {
+                    options.lt = true;
+                }
+                else if (flag == "CH")
+                {
+                    options.ch = true;
+                }
+                else
+                {
+                    break;
+                }
+            }
+
+            if (tokens.size() < 2 || first == tokens.size() || (tokens.size() - first) % 2 != 0)
+            {
+                return encode_error("ZADD command requires a key and score/member pairs");
+            }
+            if ((options.nx && options.xx) || (options.gt && options.lt) || (options.nx && (options.gt || options.lt)))
             {
-                return encode_error("ZADD command requires 3 arguments");
+                return encode_error("ZADD options NX, XX, GT and LT conflict");
             }
 
             const std::string &key = tokens[1];
-            double score;
+            std::vector<std::pair<std::string, double>> members;
+            members.reserve((tokens.size() - first) / 2);
 
+            // Parse every score first so a bad one leaves the set untouched
             try
             {
-                score = std::stod(tokens[2]);
+                for (size_t i = first; i < tokens.size(); i += 2)
+                {
+                    members.emplace_back(tokens[i + 1], std::stod(tokens[i]));
+                }
             }
-            catch (const std::invalid_argument &)
+            catch (const std::exception &)
             {
                 return encode_error("Score must be a valid number");
             }
 
-            const std::string &member = tokens[3];
-            bool added = store_.zadd(key, member, score);
-            return added ? encode_integer(1) : encode_integer(0);
+            return encode_integer(store_.zadd(key, std::move(members), options));
         }
         else if (command == "ZREM")
         {
@@ -264,37 +782,796 @@ namespace kv
             size_t size = store_.zsize(key);
             return encode_integer(size);
         }
-        else
-        {
-            return encode_error("Unknown command");
-        }
-    }
-
-    void TCPServer::start()
-    { // Start the server
-        running_ = true;
-        std::cout << "Server started, waiting for connections..." << std::endl;
-        while (running_)
+        else if (command == "ZPOPMIN" || command == "ZPOPMAX")
         {
-            struct sockaddr_in client_addr;
-            socklen_t client_len = sizeof(client_addr);
-
-            int client_sock = accept(server_sock_, (struct sockaddr *)&client_addr, &client_len); // Accept an incoming connection
+            if (tokens.size() != 2 && tokens.size() != 3)
+            {
+                return encode_error(command + " command requires a key and an optional count");
+            }
 
-            if (client_sock < 0)
+            size_t count = 1;
+            if (tokens.size() == 3)
             {
-                // SOMETHING WENT WRONG AAAAHHHHH
-                if (running_)
+                try
                 {
-                    std::cerr << "Failed to accept connection" << std::endl;
+                    count = std::stoull(tokens[2]);
                 }
-
-                continue;
+                catch (const std::exception &)
+                {
+                    return encode_error("Count must be a valid integer");
+                }
+            }
+
+            auto popped = command == "ZPOPMAX" ? store_.zpopmax(tokens[1], count) : store_.zpopmin(tokens[1], count);
+
+            if (popped.empty())
+            {
+                return encode_null_bulk_string();
+            }
+
+            std::vector<std::string> elements;
+
+            for (const auto &[member, score] : popped)
+            {
+                elements.push_back(member);
+                elements.push_back(std::to_string(score));
+            }
+
+            return encode_array(elements);
+        }
+        else if (command == "BZPOPMIN" || command == "BZPOPMAX")
+        {
+            if (tokens.size() < 3)
+            {
+                return encode_error(command + " command requires at least 1 key and a timeout");
+            }
+
+            return block_pop(tokens, session);
+        }
+        else if (command == "ZUNIONSTORE" || command == "ZINTERSTORE")
+        {
+            // dest numkeys key [key ...] [WEIGHTS w [w ...]] [AGGREGATE SUM|MIN|MAX]
+            if (tokens.size() < 4)
+            {
+                return encode_error(command + " command requires a destination, numkeys and keys");
+            }
+
+            // Signed, so "-1" is rejected instead of wrapping to a huge count
+            long long parsed;
+            try
+            {
+                parsed = std::stoll(tokens[2]);
+            }
+            catch (const std::exception &)
+            {
+                return encode_error("numkeys must be a valid integer");
+            }
+
+            if (parsed <= 0 || static_cast<unsigned long long>(parsed) > tokens.size() - 3)
+            {
+                return encode_error("numkeys must be positive and match the keys given");
+            }
+            size_t numkeys = static_cast<size_t>(parsed);
+
+            std::vector<std::string> keys(tokens.begin() + 3, tokens.begin() + 3 + numkeys);
+            std::vector<double> weights(numkeys, 1.0);
+            Aggregate aggregate = Aggregate::Sum;
+
+            for (size_t i = 3 + numkeys; i < tokens.size();)
+            {
+                if (tokens[i] == "WEIGHTS" && i + numkeys < tokens.size())
+                {
+                    try
+                    {
+                        for (size_t k = 0; k < numkeys; k++)
+                        {
+                            weights[k] = std::stod(tokens[i + 1 + k]);
+                        }
+                    }
+                    catch (const std::exception &)
+                    {
+                        return encode_error("Weights must be valid numbers");
+                    }
+                    i += 1 + numkeys;
+                }
+                else if (tokens[i] == "AGGREGATE" && i + 1 < tokens.size())
+                {
+                    const std::string &name = tokens[i + 1];
+                    if (name == "SUM")
+                    {
+                        aggregate = Aggregate::Sum;
+                    }
+                    else if (name == "MIN")
+                    {
+                        aggregate = Aggregate::Min;
+                    }
+                    else if (name == "MAX")
+                    {
+                        aggregate = Aggregate::Max;
+                    }
+                    else
+                    {
+                        return encode_error("AGGREGATE must be SUM, MIN or MAX");
+                    }
+                    i += 2;
+                }
+                else
+                {
+                    return encode_error("Syntax error");
+                }
+            }
+
+            size_t stored = command == "ZUNIONSTORE" ? store_.zunionstore(tokens[1], keys, weights, aggregate)
+                                                     : store_.zinterstore(tokens[1], keys, weights, aggregate);
+            return encode_integer(stored);
+        }
+        else if (command == "HSET")
+        {
+            if (tokens.size() < 4 || tokens.size() % 2 != 0)
+            {
+                return encode_error("HSET command requires a key and field/value pairs");
+            }
+
+            std::vector<std::pair<std::string, std::string>> fields;
+            for (size_t i = 2; i < tokens.size(); i += 2)
+            {
+                fields.emplace_back(tokens[i], tokens[i + 1]);
+            }
+
+            return encode_integer(store_.hset(tokens[1], fields));
+        }
+        else if (command == "HGET")
+        {
+            if (tokens.size() != 3)
+            {
+                return encode_error("HGET command requires 2 arguments");
+            }
+
+            auto value = store_.hget(tokens[1], tokens[2]);
+            return value ? encode_bulk_string(*value) : encode_null_bulk_string();
+        }
+        else if (command == "HMGET")
+        {
+            if (tokens.size() < 3)
+            {
+                return encode_error("HMGET command requires a key and at least 1 field");
+            }
+
+            std::vector<std::string> fields(tokens.begin() + 2, tokens.end());
+            auto values = store_.hmget(tokens[1], fields);
+
+            // Missing fields are null entries, which encode_array can't express
+            std::string res = "*" + std::to_string(values.size()) + "\r\n";
+            for (const auto &value : values)
+            {
+                res += value ? encode_bulk_string(*value) : encode_null_bulk_string();
+            }
+            return res;
+        }
+        else if (command == "HDEL")
+        {
+            if (tokens.size() < 3)
+            {
+                return encode_error("HDEL command requires a key and at least 1 field");
+            }
+
+            std::vector<std::string> fields(tokens.begin() + 2, tokens.end());
+            return encode_integer(store_.hdel(tokens[1], fields));
+        }
+        else if (command == "HLEN")
+        {
+            if (tokens.size() != 2)
+            {
+                return encode_error("HLEN command requires 1 argument");
+            }
+
+            return encode_integer(store_.hlen(tokens[1]));
+        }
+        else if (command == "HGETALL")
+        {
+            if (tokens.size() != 2)
+            {
+                return encode_error("HGETALL command requires 1 argument");
+            }
+
+            auto entries = store_.hgetall(tokens[1]);
+
+            if (entries.empty())
+            {
+                return encode_null_bulk_string();
+            }
+
+            std::vector<std::string> elements;
+
+            for (const auto &[field, value] : entries)
+            {
+                elements.push_back(field);
+                elements.push_back(value);
+            }
+
+            return encode_array(elements);
+        }
+        else if (command == "HINCRBY")
+        {
+            if (tokens.size() != 4)
+            {
+                return encode_error("HINCRBY command requires 3 arguments");
+            }
+
+            long long delta;
+
+            try
+            {
+                delta = std::stoll(tokens[3]);
+            }
+            catch (const std::exception &)
+            {
+                return encode_error("Increment must be a valid integer");
+            }
+
+            auto result = store_.hincrby(tokens[1], tokens[2], delta);
+            if (!result)
+            {
+                return encode_error("Hash value is not an integer or out of range");
+            }
+            return encode_integer(*result);
+        }
+        else if (command == "PFADD")
+        {
+            if (tokens.size() < 2)
+            {
+                return encode_error("PFADD command requires a key");
+            }
+
+            std::vector<std::string> elements(tokens.begin() + 2, tokens.end());
+            return encode_integer(store_.pfadd(tokens[1], elements) ? 1 : 0);
+        }
+        else if (command == "PFCOUNT")
+        {
+            if (tokens.size() < 2)
+            {
+                return encode_error("PFCOUNT command requires at least one key");
+            }
+
+            std::vector<std::string> keys(tokens.begin() + 1, tokens.end());
+            return encode_integer(static_cast<long long>(store_.pfcount(keys)));
+        }
+        else if (command == "PFMERGE")
+        {
+            if (tokens.size() < 2)
+            {
+                return encode_error("PFMERGE command requires a destination key");
+            }
+
+            std::vector<std::string> sources(tokens.begin() + 2, tokens.end());
+            store_.pfmerge(tokens[1], sources);
+            return encode_simple_string("OK");
+        }
+        else if (command == "BF.RESERVE")
+        {
+            if (tokens.size() != 4)
+            {
+                return encode_error("BF.RESERVE command requires 3 arguments");
+            }
+
+            double error_rate;
+            unsigned long long capacity;
+            try
+            {
+                error_rate = std::stod(tokens[2]);
+                capacity = std::stoull(tokens[3]);
+            }
+            catch (const std::exception &)
+            {
+                return encode_error("Error rate and capacity must be numbers");
+            }
+
+            if (!(error_rate > 0 && error_rate < 1) || capacity == 0 || capacity > kMaxBloomCapacity)
+            {
+                return encode_error("Error rate must be between 0 and 1 and capacity between 1 and " + std::to_string(kMaxBloomCapacity));
+            }
+
+            if (!store_.bfreserve(tokens[1], error_rate, capacity))
+            {
+                return encode_error("item exists");
+            }
+            return encode_simple_string("OK");
+        }
+        else if (command == "BF.ADD" || command == "BF.EXISTS")
+        {
+            if (tokens.size() != 3)
+            {
+                return encode_error(command + " command requires 2 arguments");
+            }
+
+            auto flags = command == "BF.ADD" ? store_.bfadd(tokens[1], {tokens[2]}) : store_.bfexists(tokens[1], {tokens[2]});
+            return encode_integer(flags[0] ? 1 : 0);
+        }
+        else if (command == "BF.MADD" || command == "BF.MEXISTS")
+        {
+            if (tokens.size() < 3)
+            {
+                return encode_error(command + " command requires a key and at least one item");
+            }
+
+            std::vector<std::string> items(tokens.begin() + 2, tokens.end());
+            return encode_flags(command == "BF.MADD" ? store_.bfadd(tokens[1], items) : store_.bfexists(tokens[1], items));
+        }
+        else if (command == "RESTORE")
+        {
+            if (tokens.size() != 3)
+            {
+                return encode_error("RESTORE command requires 2 arguments");
+            }
+
+            auto bytes = decode_hex(tokens[2]);
+            if (!bytes || !store_.restore(tokens[1], *bytes))
+            {
+                return encode_error("RESTORE payload is not a serialized HyperLogLog or Bloom filter");
+            }
+            return encode_simple_string("OK");
+        }
+        else if (command == "HOTKEYS")
+        {
+            if (tokens.size() > 2)
+            {
+                return encode_error("HOTKEYS command takes an optional count");
+            }
+
+            size_t count = 10;
+            try
+            {
+                if (tokens.size() == 2)
+                {
+                    count = std::stoull(tokens[1]);
+                }
+            }
+            catch (const std::exception &)
+            {
+                return encode_error("Count must be a valid integer");
+            }
+
+            // [[key, estimated reads], ...], hottest first
+            auto hot = store_.hot_keys(count);
+            std::string res = "*" + std::to_string(hot.size()) + "\r\n";
+            for (const auto &[key, reads] : hot)
+            {
+                res += "*2\r\n" + encode_bulk_string(key) + encode_integer(reads);
+            }
+            return res;
+        }
+        else if (command == "RESHARD")
+        {
+            if (tokens.size() != 2)
+            {
+                return encode_error("RESHARD command requires a shard count");
+            }
+
+            size_t shards;
+            try
+            {
+                shards = std::stoull(tokens[1]);
+            }
+            catch (const std::exception &)
+            {
+                return encode_error("Shard count must be a valid integer");
+            }
+
+            // Keys move in the background (reshard_loop); INFO reports progress
+            if (!store_.reshard(shards))
+            {
+                return encode_error("Reshard already running, or the count is 0, unchanged or above " + std::to_string(store_.max_shards()));
+            }
+            return encode_simple_string("OK");
+        }
+        else if (command == "INFO")
+        {
+            auto status = store_.reshard_status();
+            std::string info = "shards:" + std::to_string(status.shards) + "\r\n" +
+                               "resharding:" + std::to_string(status.in_progress() ? 1 : 0) + "\r\n" +
+                               "reshard_target:" + std::to_string(status.target) + "\r\n" +
+                               "reshard_sources_done:" + std::to_string(status.sources_done) + "\r\n" +
+                               "reshard_keys_moved:" + std::to_string(status.keys_moved) + "\r\n";
+            return encode_bulk_string(info);
+        }
+        else if (command == "CHANGES")
+        {
+            if (tokens.size() != 2 && tokens.size() != 3)
+            {
+                return encode_error("CHANGES command requires a sequence number and an optional count");
+            }
+
+            uint64_t from;
+            size_t count = 100;
+            try
+            {
+                from = std::stoull(tokens[1]);
+                if (tokens.size() == 3)
+                {
+                    count = std::stoull(tokens[2]);
+                }
+            }
+            catch (const std::exception &)
+            {
+                return encode_error("Sequence and count must be valid integers");
+            }
+
+            if (!store_.change_stream_enabled())
+            {
+                return encode_error("Change stream is disabled, start the server with --cdc");
+            }
+
+            if (count == 0)
+            {
+                return encode_error("Count must be positive");
+            }
+
+            std::vector<ChangeEvent> events;
+            uint64_t next;
+            if (!store_.read_changes(from, count, events, next))
+            {
+                return encode_error("Changes from " + tokens[1] + " are no longer buffered, resync with ALL");
+            }
+
+            // [next sequence to ask for, [events...]]
+            std::string res = "*2\r\n" + encode_integer(next) + "*" + std::to_string(events.size()) + "\r\n";
+            for (const auto &e : events)
+            {
+                res += encode_change(e);
+            }
+            return res;
+        }
+        else if (command == "SUBSCRIBE" || command == "PSUBSCRIBE" || command == "UNSUBSCRIBE" || command == "PUNSUBSCRIBE")
+        {
+            return subscribe_command(tokens, session);
+        }
+        else if (command == "PUBLISH")
+        {
+            if (tokens.size() != 3)
+            {
+                return encode_error("PUBLISH command requires 2 arguments");
+            }
+
+            return encode_integer(pubsub_.publish(tokens[1], tokens[2]));
+        }
+        else if (command == "PSYNC")
+        {
+            if (tokens.size() != 3)
+            {
+                return encode_error("PSYNC command requires 2 arguments");
+            }
+
+            try
+            {
+                session.psync_offset = std::stoull(tokens[2]);
+            }
+            catch (const std::exception &)
+            {
+                return encode_error("Offset must be a valid integer");
+            }
+
+            // The connection's reader hands the socket to serve_replica
+            session.psync = true;
+            session.psync_replid = tokens[1];
+            return "";
+        }
+        else
+        {
+            return encode_error("Unknown command");
+        }
+    }
+
+    std::string TCPServer::subscribe_command(const CommandArgs &tokens, ClientSession &session)
+    {
+        const std::string &command = tokens[0];
+        bool pattern = command[0] == 'P';
+        auto &subscribed = pattern ? session.patterns : session.channels;
+        std::string kind = command;
+        for (auto &c : kind)
+        {
+            c = static_cast<char>(tolower(c));
+        }
+
+        std::string res;
+
+        if (command == "SUBSCRIBE" || command == "PSUBSCRIBE")
+        {
+            if (tokens.size() < 2)
+            {
+                return encode_error(command + " command requires at least 1 argument");
+            }
+
+            if (!session.mailbox)
+            {
+                session.mailbox = std::make_shared<Mailbox>(subscriber_limits_);
+            }
+
+            for (size_t i = 1; i < tokens.size(); i++)
+            {
+                if (subscribed.insert(tokens[i]).second)
+                {
+                    pattern ? pubsub_.psubscribe(tokens[i], session.mailbox) : pubsub_.subscribe(tokens[i], session.mailbox);
+                }
+                res += subscription_reply(kind, &tokens[i], session.channels.size() + session.patterns.size());
+            }
+            return res;
+        }
+
+        // No arguments drops every subscription of that kind
+        std::vector<std::string> names(tokens.begin() + 1, tokens.end());
+        if (names.empty())
+        {
+            names.assign(subscribed.begin(), subscribed.end());
+        }
+
+        if (names.empty())
+        {
+            return subscription_reply(kind, nullptr, session.channels.size() + session.patterns.size());
+        }
+
+        for (const auto &name : names)
+        {
+            if (subscribed.erase(name) > 0)
+            {
+                pattern ? pubsub_.punsubscribe(name, session.mailbox.get()) : pubsub_.unsubscribe(name, session.mailbox.get());
+            }
+            res += subscription_reply(kind, &name, session.channels.size() + session.patterns.size());
+        }
+        return res;
+    }
+
+    bool TCPServer::drain_mailbox(ClientSession &session, OutputBuffer &out)
+    {
+        session.mailbox->clear_notification();
+
+        std::shared_ptr<const std::string> msg;
+        while (session.mailbox->pop(msg))
+        {
+            out.append_shared(std::move(msg));
+        }
+
+        if (session.mailbox->overflowed())
+        {
+            std::cerr << "Subscriber exceeded its output buffer limit, disconnecting" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    std::string TCPServer::block_pop(const CommandArgs &tokens, ClientSession &session)
+    {
+        double timeout;
+        try
+        {
+            timeout = std::stod(tokens.back());
+        }
+        catch (const std::exception &)
+        {
+            return encode_error("Timeout must be a valid number");
+        }
+
+        if (!std::isfinite(timeout))
+        {
+            return encode_error("Timeout must be a finite number");
+        }
+        if (timeout < 0)
+        {
+            return encode_error("Timeout can't be negative");
+        }
+
+        BlockedPop pop;
+        pop.keys.assign(tokens.begin() + 1, tokens.end() - 1);
+        pop.max = tokens[0] == "BZPOPMAX";
+        pop.has_deadline = timeout > 0 && timeout <= kMaxBlockSeconds;
+        if (pop.has_deadline)
+        {
+            pop.deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout));
+        }
+
+        // Park before trying, so a ZADD landing between the attempt and parking still wakes us
+        if (!session.mailbox)
+        {
+            session.mailbox = std::make_shared<Mailbox>(subscriber_limits_);
+        }
+        for (const auto &key : pop.keys)
+        {
+            waiters_.add(key, session.mailbox);
+        }
+        session.blocked = std::move(pop);
+
+        std::string res = pop_any(*session.blocked);
+        if (!res.empty())
+        {
+            unblock(session);
+        }
+        return res;
+    }
+
+    std::string TCPServer::pop_any(const BlockedPop &pop)
+    {
+        for (const auto &key : pop.keys)
+        {
+            auto popped = pop.max ? store_.zpopmax(key, 1) : store_.zpopmin(key, 1);
+            if (!popped.empty())
+            {
+                return encode_array({key, popped[0].first, std::to_string(popped[0].second)});
+            }
+        }
+        return "";
+    }
+
+    void TCPServer::serve_blocked(ClientSession &session, OutputBuffer &out)
+    {
+        if (!session.blocked)
+        {
+            return;
+        }
+
+        std::string res;
+        try
+        {
+            res = pop_any(*session.blocked);
+        }
+        catch (const WrongTypeError &e)
+        {
+            res = "-" + std::string(e.what()) + "\r\n";
+        }
+
+        if (res.empty() && session.blocked->has_deadline && std::chrono::steady_clock::now() >= session.blocked->deadline)
+        {
+            res = encode_null_bulk_string();
+        }
+
+        if (!res.empty())
+        {
+            unblock(session);
+            out.append(res);
+        }
+    }
+
+    void TCPServer::unblock(ClientSession &session)
+    {
+        if (!session.blocked)
+        {
+            return;
+        }
+
+        for (const auto &key : session.blocked->keys)
+        {
+            waiters_.remove(key, session.mailbox.get());
+        }
+        session.blocked.reset();
+    }
+
+    void TCPServer::release_session(ClientSession &session)
+    {
+        unblock(session);
+
+        for (const auto &channel : session.channels)
+        {
+            pubsub_.unsubscribe(channel, session.mailbox.get());
+        }
+        for (const auto &pattern : session.patterns)
+        {
+            pubsub_.punsubscribe(pattern, session.mailbox.get());
+        }
+
+        session.channels.clear();
+        session.patterns.clear();
+    }
+
+    void TCPServer::start()
+    { // Start the server
+        open_listeners();
+        running_ = true;
+
+        if (!primary_host_.empty())
+        {
+            threads_.emplace_back(&TCPServer::replica_loop, this);
+        }
+        else
+        {
+            threads_.emplace_back(&TCPServer::expire_loop, this);
+        }
+        threads_.emplace_back(&TCPServer::reshard_loop, this);
+
+        if (backend_ == Backend::IoUring)
+        {
+            if (run_uring())
+            {
+                return;
+            }
+
+            std::cerr << "io_uring unavailable, falling back to thread-per-client" << std::endl;
+        }
+
+        run_threads();
+    }
+
+    void TCPServer::enable_change_stream(size_t bytes_per_shard)
+    {
+        store_.enable_change_stream(bytes_per_shard);
+    }
+
+    void TCPServer::enable_key_index()
+    {
+        store_.enable_key_index();
+    }
+
+    void TCPServer::enable_hot_key_cache()
+    {
+        store_.enable_hot_key_cache();
+    }
+
+    // Active expiry, so keys nobody reads again still go (and show up in the change stream)
+    void TCPServer::expire_loop()
+    {
+        while (running_)
+        {
+            store_.expire_due();
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+
+    // Moves keys for a RESHARD in small batches, so scans waiting on a batch never wait long
+    void TCPServer::reshard_loop()
+    {
+        while (running_)
+        {
+            if (!store_.reshard_step(1024))
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+    }
+
+    void TCPServer::run_threads()
+    {
+        std::cout << "Server started, waiting for connections..." << std::endl;
+
+        // The kernel spreads new connections over the SO_REUSEPORT listeners
+        for (size_t i = 1; i < listeners_.size(); i++)
+        {
+            acceptors_.emplace_back(&TCPServer::accept_loop, this, listeners_[i]);
+        }
+        accept_loop(listeners_[0]);
+    }
+
+    void TCPServer::accept_loop(Listener listener)
+    {
+        while (running_)
+        {
+            struct sockaddr_storage client_addr;
+            socklen_t client_len = sizeof(client_addr);
+
+            int client_sock = accept(listener.fd, (struct sockaddr *)&client_addr, &client_len); // Accept an incoming connection
+
+            if (client_sock < 0)
+            {
+                // SOMETHING WENT WRONG AAAAHHHHH
+                if (running_)
+                {
+                    std::cerr << "Failed to accept connection" << std::endl;
+                }
+
+                continue;
             }
 
             // Now do stuff with the connection
 
-            std::cout << "Accepted connection from " << inet_ntoa(client_addr.sin_addr) << ":" << ntohs(client_addr.sin_port) << std::endl;
+            if (listener.tcp)
+            {
+                int one = 1;
+                setsockopt(client_sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // replies go out as soon as they are written
+                auto *addr = (struct sockaddr_in *)&client_addr;
+                std::cout << "Accepted connection from " << inet_ntoa(addr->sin_addr) << ":" << ntohs(addr->sin_port) << std::endl;
+            }
+            else
+            {
+                std::cout << "Accepted connection on " << listen_options_.unix_path << std::endl;
+            }
+
+            std::lock_guard lock(threads_mutex_);
             threads_.emplace_back(&TCPServer::handle_client, this, client_sock); // Handle the client in a new thread
         }
     }
@@ -304,62 +1581,156 @@ namespace kv
         // Handle el cliente here
         std::string accumulated_buffer;
         char recv_buffer[1024];
+        ClientSession session;
+        OutputBuffer response;
 
         while (running_)
         {
-            memset(recv_buffer, 0, sizeof(recv_buffer));
+            bool readable = true;
 
-            ssize_t bytes_read = recv(client_sock, recv_buffer, sizeof(recv_buffer) - 1, 0);
-            if (bytes_read <= 0)
+            // Subscribers and blocked pops also wait on their mailbox, the latter with a timeout
+            if (session.mailbox)
             {
-                // Something went wrong or client disconnected
-                break;
-            }
+                int timeout_ms = -1;
+                if (session.blocked && session.blocked->has_deadline)
+                {
+                    auto left = std::chrono::ceil<std::chrono::milliseconds>(session.blocked->deadline - std::chrono::steady_clock::now());
+                    timeout_ms = static_cast<int>(std::max<long long>(0, left.count()));
+                }
 
-            // Append new data to accumulated buffer
-            accumulated_buffer.append(recv_buffer, bytes_read);
+                pollfd fds[2] = {{client_sock, POLLIN, 0}, {session.mailbox->fd(), POLLIN, 0}};
+                if (poll(fds, 2, timeout_ms) < 0)
+                {
+                    break;
+                }
+                readable = fds[0].revents != 0;
+            }
 
-            // Process all complete commands (those ending with \n)
-            size_t pos;
-            while ((pos = accumulated_buffer.find('\n')) != std::string::npos)
+            if (readable)
             {
-                // Extract command up to the newline
-                std::string command = accumulated_buffer.substr(0, pos);
-                
-                // Remove \r if present (handle \r\n line endings)
-                if (!command.empty() && command.back() == '\r')
+                memset(recv_buffer, 0, sizeof(recv_buffer));
+
+                ssize_t bytes_read = recv(client_sock, recv_buffer, sizeof(recv_buffer) - 1, 0);
+                if (bytes_read <= 0)
                 {
-                    command.pop_back();
+                    // Something went wrong or client disconnected
+                    break;
                 }
 
-                // Process the command and send response
-                std::string response = process_command(command);
-                send(client_sock, response.c_str(), response.size(), 0);
+                // Append new data to accumulated buffer
+                accumulated_buffer.append(recv_buffer, bytes_read);
+
+                // Run every complete command and answer the whole batch with one send
+                consume_input(accumulated_buffer, response, session);
+            }
+
+            if (session.mailbox && !drain_mailbox(session, response))
+            {
+                break;
+            }
+
+            if (session.blocked)
+            {
+                // Once served, carry on with whatever was pipelined behind the pop
+                serve_blocked(session, response);
+                consume_input(accumulated_buffer, response, session);
+            }
+
+            if (!response.flush(client_sock))
+            {
+                break;
+            }
 
-                // Remove processed command from buffer (including the \n)
-                accumulated_buffer.erase(0, pos + 1);
+            if (session.psync)
+            {
+                serve_replica(client_sock, session);
+                break;
             }
         }
 
+        release_session(session);
         close(client_sock);
         std::cout << "Client disconnected." << std::endl;
     }
 
+    void TCPServer::consume_input(std::string &buffer, OutputBuffer &out, ClientSession &session)
+    {
+        // Process all complete commands (those ending with \n)
+        size_t start = 0;
+        size_t pos;
+        while (!session.psync && !session.blocked && (pos = buffer.find('\n', start)) != std::string::npos)
+        {
+            // The command up to the newline, without a trailing \r
+            std::string_view command(buffer.data() + start, pos - start);
+            if (!command.empty() && command.back() == '\r')
+            {
+                command.remove_suffix(1);
+            }
+
+            // Everything parsed for this command is dropped once its reply is queued
+            ArenaScope scope(request_arena);
+            DirectReplyScope direct(&out);
+            out.append(process_command(command, session));
+            start = pos + 1;
+        }
+
+        // Drop processed commands in one go, keep any partial command for the next read
+        buffer.erase(0, start);
+    }
+
 void TCPServer::stop()
 {
     running_ = false;
-    close(server_sock_);
-    server_sock_ = -1;
 
-    for (auto &t : threads_)
+    // shutdown() wakes threads blocked in accept() on the listener
+    for (const auto &listener : listeners_)
+    {
+        shutdown(listener.fd, SHUT_RDWR);
+    }
+    for (auto &t : acceptors_)
     {
         if (t.joinable())
         {
             t.join();
         }
     }
+    acceptors_.clear();
+
+    for (const auto &listener : listeners_)
+    {
+        close(listener.fd);
+        if (!listener.tcp)
+        {
+            unlink(listen_options_.unix_path.c_str());
+        }
+    }
+    listeners_.clear();
+
+    int primary_sock = primary_sock_.exchange(-1);
+    if (primary_sock >= 0)
+    {
+        shutdown(primary_sock, SHUT_RDWR); // unblocks the replica thread's recv
+    }
+
+    int wake_fd = wake_fd_.load();
+    if (wake_fd >= 0)
+    {
+        uint64_t one = 1;
+        write(wake_fd, &one, sizeof(one)); // io_uring loop exits once it sees the wakeup
+    }
 
-    threads_.clear();
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard lock(threads_mutex_);
+        threads.swap(threads_);
+    }
+    for (auto &t : threads)
+    {
+        if (t.joinable())
+        {
+            t.join();
+        }
+    }
     std::cout << "Server stopped." << std::endl;
 }
 
@@ -370,41 +1741,4 @@ TCPServer::~TCPServer()
 
     // I will close server sock in stop() function
 }
-
-std::string TCPServer::encode_simple_string(const std::string &str)
-{
-    return "+" + str + "\r\n";
-}
-
-std::string TCPServer::encode_error(const std::string &err)
-{
-    return "-ERR " + err + "\r\n";
-}
-
-std::string TCPServer::encode_integer(long long val)
-{
-    return ":" + std::to_string(val) + "\r\n";
-}
-
-std::string TCPServer::encode_bulk_string(const std::string &str)
-{
-    return "$" + std::to_string(str.size()) + "\r\n" + str + "\r\n";
-}
-
-std::string TCPServer::encode_null_bulk_string()
-{
-    return "$-1\r\n";
-}
-
-std::string TCPServer::encode_array(const std::vector<std::string> &elements)
-{
-    std::string res = "*" + std::to_string(elements.size()) + "\r\n";
-
-    for (const auto &el : elements)
-    {
-        res += encode_bulk_string(el);
-    }
-
-    return res;
-}
 }
\ No newline at end of file
@@ -1,35 +1,170 @@
 #pragma once
 #include "../kv/kvstore.h"
+#include "../repl/backlog.h"
+#include "../pubsub/pubsub.h"
+#include "../pubsub/key_waiters.h"
+#include "output_buffer.h"
+#include "resp.h"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <set>
 #include <string>
 #include <thread>
 #include <vector>
 #include <atomic>
+#include <mutex>
 
 namespace kv {
+    // How client connections are driven once accepted
+    enum class Backend {
+        Threads,    // one blocking thread per client (handle_client)
+        IoUring     // single event loop on io_uring, falls back to Threads if unsupported
+    };
+
+    // Where and how the server accepts clients
+    struct ListenOptions {
+        int acceptors = 1;      // TCP listeners sharing the port with SO_REUSEPORT, each with its own accept thread
+        int send_buffer = 0;    // SO_SNDBUF/SO_RCVBUF for client sockets (set on the listeners, which
+        int recv_buffer = 0;    // accepted sockets inherit); 0 keeps the kernel default
+        std::string unix_path;  // also listen on this AF_UNIX socket when set
+    };
+
+    // Writes all of data, retrying short sends. False if the peer went away.
+    bool send_all(int sock, const std::string &data);
+
+    // A BZPOPMIN/BZPOPMAX waiting for one of its keys to get a member
+    struct BlockedPop {
+        std::vector<std::string> keys;
+        bool max = false;
+        bool has_deadline = false; // a timeout of 0 waits forever
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    // The arguments of one command wherever they are stored: the parsing arena, or
+    // ClientSession::queued inside MULTI
+    class CommandArgs {
+        public:
+            template <typename Alloc>
+            CommandArgs(const std::vector<std::string, Alloc> &args) : data_(args.data()), size_(args.size()) {}
+
+            const std::string &operator[](size_t i) const { return data_[i]; }
+            size_t size() const { return size_; }
+            bool empty() const { return size_ == 0; }
+            const std::string *begin() const { return data_; }
+            const std::string *end() const { return data_ + size_; }
+            const std::string &back() const { return data_[size_ - 1]; }
+
+        private:
+            const std::string *data_;
+            size_t size_;
+    };
+
+    // Per-connection state, shared by both backends
+    struct ClientSession {
+        bool from_primary = false;  // replication link on a replica: writes are allowed
+        bool psync = false;         // PSYNC received, the socket becomes a replication stream
+        std::string psync_replid;
+        uint64_t psync_offset = 0;
+
+        bool in_multi = false;      // between MULTI and EXEC/DISCARD
+        std::vector<std::vector<std::string>> queued;
+
+        std::shared_ptr<Mailbox> mailbox; // created on the first (P)SUBSCRIBE
+        std::set<std::string> channels;
+        std::set<std::string> patterns;
+
+        std::optional<BlockedPop> blocked; // no further input is read until it is served
+    };
+
     class TCPServer {
         public:
-            TCPServer(int port, int num_shards = 16);
+            TCPServer(int port, int num_shards = 16, Backend backend = Backend::Threads);
             ~TCPServer();
 
+            // Run as a read-only replica of host:port. Call before start().
+            void set_replica_of(const std::string &host, int port);
+
+            // Keep a change stream clients can read with CHANGES. Call before start().
+            void enable_change_stream(size_t bytes_per_shard);
+
+            // Index key names for KEYS and SCAN. Call before start().
+            void enable_key_index();
+
+            // Serve GETs of hot keys from per-thread copies, see KVStore::enable_hot_key_cache. Call before start().
+            void enable_hot_key_cache();
+
+            // Listeners are opened by start(), which throws if one can't be bound. Call before start().
+            void set_listen_options(const ListenOptions &options);
+
             void start();
             void stop();
         
         private:
+            struct Listener {
+                int fd;
+                bool tcp; // false for the AF_UNIX listener
+            };
+
+            void open_listeners();
+            int open_listener(int family, bool reuse_port);
+            void accept_loop(Listener listener);
             void handle_client(int client_sock);
-            std::string process_command(const std::string &cmdline);
+            void run_threads();
+            bool run_uring(); // false if io_uring isn't usable on this kernel
+            void consume_input(std::string &buffer, OutputBuffer &out, ClientSession &session);
+            // cmdline's arguments are parsed into the calling thread's request arena
+            std::string process_command(std::string_view cmdline, ClientSession &session);
+            std::string execute_command(const CommandArgs &tokens, ClientSession &session);
+            std::string dispatch_command(const CommandArgs &tokens, ClientSession &session);
+            std::string exec_transaction(ClientSession &session);
+            // Adds the keys a command touches; false if it needs every shard
+            static bool collect_keys(const CommandArgs &tokens, std::vector<std::string> &keys);
+            void expire_loop();
+            void reshard_loop();
+
+            // Pub/sub
+            std::string subscribe_command(const CommandArgs &tokens, ClientSession &session);
+            // Moves published messages into out; false if the client overran its output limits
+            bool drain_mailbox(ClientSession &session, OutputBuffer &out);
+            void release_session(ClientSession &session);
+
+            // Blocking pops (a woken or timed-out connection calls serve_blocked)
+            std::string block_pop(const CommandArgs &tokens, ClientSession &session);
+            std::string pop_any(const BlockedPop &pop);
+            void serve_blocked(ClientSession &session, OutputBuffer &out);
+            void unblock(ClientSession &session);
+
+            // Replication (replication.cpp)
+            void record_mutation(const Mutation &m);
+            void serve_replica(int sock, const ClientSession &session);
+            void replica_loop();
+            bool sync_with_primary(int sock);
+            static std::string new_replid();
 
             KVStore store_;
             int port_;
-            int server_sock_;
+            ListenOptions listen_options_;
+            std::vector<Listener> listeners_;
             std::atomic<bool> running_;
+            std::vector<std::thread> acceptors_; // accept loops for listeners_[1..]
+            std::mutex threads_mutex_;           // acceptors and the replica hand-off add to threads_
             std::vector<std::thread> threads_;
+            Backend backend_;
+            std::atomic<int> wake_fd_; // eventfd used to interrupt the io_uring loop
+
+            ReplicationBacklog backlog_;
+            std::string replid_;
+            std::string primary_host_; // empty unless running as a replica
+            int primary_port_ = 0;
+            std::string primary_replid_;
+            uint64_t primary_offset_ = 0;
+            std::atomic<int> primary_sock_{-1};
 
-            std::string encode_simple_string (const std::string& str);
-            std::string encode_error (const std::string& err);
-            std::string encode_integer (long long val);
-            std::string encode_bulk_string (const std::string& str);
-            std::string encode_null_bulk_string();
-            std::string encode_array(const std::vector<std::string>& elements);
+            PubSub pubsub_;
+            OutputLimits subscriber_limits_;
+            KeyWaiters waiters_;
 
 
 
@@ -0,0 +1,447 @@
+#include "tcp_server.h"
+#include "io_uring.h"
+#include <deque>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+
+// io_uring backend for TCPServer: one thread, multishot accept, multishot recv into a
+// provided buffer ring, and all sends for a loop iteration submitted with one io_uring_enter.
+// Subscribers get a READ armed on their mailbox eventfd so published messages wake the loop;
+// a blocked BZPOPMIN/BZPOPMAX is woken the same way, or by a TIMEOUT at its deadline.
+
+namespace kv
+{
+    namespace
+    {
+        constexpr unsigned kRingEntries = 4096;
+        constexpr unsigned kRecvBuffers = 512; // power of two
+        constexpr size_t kRecvBufferSize = 4096;
+        constexpr uint16_t kBufferGroup = 0;
+        constexpr size_t kSendIovecs = 64;
+
+        enum Op : uint64_t
+        {
+            OP_ACCEPT = 0,
+            OP_RECV = 1,
+            OP_SEND = 2,
+            OP_WAKE = 3,
+            OP_CANCEL = 4,
+            OP_NOTIFY = 5,
+            OP_TIMER = 6
+        };
+
+        // user_data = connection id << 3 | op; ids are never reused so stale CQEs are harmless
+        uint64_t pack(uint64_t id, Op op) { return (id << 3) | op; }
+        uint64_t conn_id(uint64_t user_data) { return user_data >> 3; }
+        Op op_of(uint64_t user_data) { return static_cast<Op>(user_data & 7); }
+
+        struct UringConn
+        {
+            int fd;
+            std::string input;
+            OutputBuffer output; // the front of it is owned by the kernel while sending
+            msghdr msg = {};
+            iovec iov[kSendIovecs];
+            bool sending = false;
+            bool recv_done = false;
+            bool watching_mailbox = false;
+            bool timer_armed = false;
+            ClientSession session;
+        };
+    }
+
+    bool TCPServer::run_uring()
+    {
+        IoUring ring;
+        if (!ring.init(kRingEntries) || !ring.register_buf_ring(kBufferGroup, kRecvBuffers, kRecvBufferSize))
+        {
+            return false;
+        }
+
+        int wake_fd = eventfd(0, EFD_CLOEXEC);
+        if (wake_fd < 0)
+        {
+            return false;
+        }
+        wake_fd_ = wake_fd;
+
+        std::unordered_map<uint64_t, UringConn> conns;
+        std::vector<uint64_t> dirty; // connections with new output this iteration
+        uint64_t next_id = 1;
+        uint64_t wake_value = 0;
+        uint64_t notify_value = 0; // shared sink for mailbox reads, the value is never used
+        std::deque<__kernel_timespec> timer_specs; // read by the kernel at submit time only
+        bool multishot_accept = true;
+        bool multishot_recv = true;
+
+        // get_sqe only fails when the SQ is full; flush it to the kernel and retry
+        auto sqe = [&ring]() {
+            io_uring_sqe *s = ring.get_sqe();
+            while (s == nullptr)
+            {
+                ring.submit_and_wait(0);
+                s = ring.get_sqe();
+            }
+            return s;
+        };
+
+        // The id of an accept is the index of its listener
+        auto arm_accept = [&](size_t listener) {
+            io_uring_sqe *s = sqe();
+            s->opcode = IORING_OP_ACCEPT;
+            s->fd = listeners_[listener].fd;
+            if (multishot_accept)
+            {
+                s->ioprio = IORING_ACCEPT_MULTISHOT;
+            }
+            s->user_data = pack(listener, OP_ACCEPT);
+        };
+
+        auto arm_recv = [&](uint64_t id, int fd) {
+            io_uring_sqe *s = sqe();
+            s->opcode = IORING_OP_RECV;
+            s->fd = fd;
+            s->flags = IOSQE_BUFFER_SELECT;
+            s->buf_group = kBufferGroup;
+            if (multishot_recv)
+            {
+                s->ioprio = IORING_RECV_MULTISHOT;
+            }
+            s->user_data = pack(id, OP_RECV);
+        };
+
+        auto arm_send = [&](uint64_t id, UringConn &conn) {
+            conn.msg.msg_iov = conn.iov;
+            conn.msg.msg_iovlen = conn.output.prepare_iovecs(conn.iov, kSendIovecs);
+
+            io_uring_sqe *s = sqe();
+            s->opcode = IORING_OP_SENDMSG;
+            s->fd = conn.fd;
+            s->addr = reinterpret_cast<uint64_t>(&conn.msg);
+            s->len = 1;
+            s->msg_flags = MSG_NOSIGNAL;
+            s->user_data = pack(id, OP_SEND);
+            conn.sending = true;
+        };
+
+        auto arm_wake = [&]() {
+            io_uring_sqe *s = sqe();
+            s->opcode = IORING_OP_READ;
+            s->fd = wake_fd;
+            s->addr = reinterpret_cast<uint64_t>(&wake_value);
+            s->len = sizeof(wake_value);
+            s->user_data = pack(0, OP_WAKE);
+        };
+
+        auto arm_notify = [&](uint64_t id, UringConn &conn) {
+            io_uring_sqe *s = sqe();
+            s->opcode = IORING_OP_READ;
+            s->fd = conn.session.mailbox->fd();
+            s->addr = reinterpret_cast<uint64_t>(&notify_value);
+            s->len = sizeof(notify_value);
+            s->user_data = pack(id, OP_NOTIFY);
+            conn.watching_mailbox = true;
+        };
+
+        // Only pulls messages in once earlier output is flushed, so a slow subscriber's
+        // backlog stays in its mailbox where the output limits apply
+        auto deliver = [&](uint64_t id, UringConn &conn) {
+            if (!conn.session.mailbox || conn.sending || !conn.output.empty())
+            {
+                return;
+            }
+
+            if (!drain_mailbox(conn.session, conn.output))
+            {
+                shutdown(conn.fd, SHUT_RDWR); // ends the multishot recv, which closes it
+            }
+            else if (!conn.output.empty())
+            {
+                dirty.push_back(id);
+            }
+        };
+
+        // Absolute CLOCK_MONOTONIC deadline, the same clock as steady_clock
+        auto arm_timer = [&](uint64_t id, UringConn &conn) {
+            auto since_epoch = conn.session.blocked->deadline.time_since_epoch();
+            auto secs = std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+            timer_specs.push_back({secs.count(), std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch - secs).count()});
+
+            io_uring_sqe *s = sqe();
+            s->opcode = IORING_OP_TIMEOUT;
+            s->fd = -1;
+            s->addr = reinterpret_cast<uint64_t>(&timer_specs.back());
+            s->len = 1;
+            s->timeout_flags = IORING_TIMEOUT_ABS;
+            s->user_data = pack(id, OP_TIMER);
+            conn.timer_armed = true;
+        };
+
+        // Serves a blocked pop if it can, then whatever input queued up behind it
+        auto resume = [&](uint64_t id, UringConn &conn) {
+            size_t before = conn.output.size();
+            serve_blocked(conn.session, conn.output);
+            consume_input(conn.input, conn.output, conn.session);
+            if (conn.output.size() != before)
+            {
+                dirty.push_back(id);
+            }
+
+            if (conn.session.blocked && conn.session.blocked->has_deadline && !conn.timer_armed)
+            {
+                arm_timer(id, conn);
+            }
+        };
+
+        auto maybe_close = [&](uint64_t id) {
+            auto it = conns.find(id);
+            if (it != conns.end() && it->second.recv_done && !it->second.sending)
+            {
+                if (it->second.watching_mailbox)
+                {
+                    io_uring_sqe *s = sqe();
+                    s->opcode = IORING_OP_ASYNC_CANCEL;
+                    s->addr = pack(id, OP_NOTIFY);
+                    s->user_data = pack(id, OP_CANCEL);
+                }
+
+                release_session(it->second.session);
+                close(it->second.fd);
+                conns.erase(it);
+                std::cout << "Client disconnected." << std::endl;
+            }
+        };
+
+        // PSYNC turns the connection into a blocking replication stream, which gets its own
+        // thread on a dup of the socket; the loop stops reading and drops its copy
+        auto hand_off_replica = [&](uint64_t id, UringConn &conn) {
+            int fd = dup(conn.fd);
+            if (fd >= 0)
+            {
+                ClientSession session = conn.session;
+                std::lock_guard lock(threads_mutex_);
+                threads_.emplace_back([this, fd, session]() {
+                    serve_replica(fd, session);
+                    close(fd);
+                });
+            }
+
+            io_uring_sqe *s = sqe();
+            s->opcode = IORING_OP_ASYNC_CANCEL;
+            s->addr = pack(id, OP_RECV);
+            s->user_data = pack(id, OP_CANCEL);
+
+            conn.recv_done = true;
+            maybe_close(id);
+        };
+
+        for (size_t i = 0; i < listeners_.size(); i++)
+        {
+            arm_accept(i);
+        }
+        arm_wake();
+
+        std::cout << "Server started (io_uring), waiting for connections..." << std::endl;
+
+        while (running_)
+        {
+            int ret = ring.submit_and_wait(1);
+            timer_specs.clear();
+            if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY)
+            {
+                std::cerr << "io_uring_enter failed: " << -ret << std::endl;
+                break;
+            }
+
+            ring.for_each_cqe([&](const io_uring_cqe &cqe) {
+                uint64_t id = conn_id(cqe.user_data);
+                bool more = cqe.flags & IORING_CQE_F_MORE;
+
+                switch (op_of(cqe.user_data))
+                {
+                case OP_ACCEPT:
+                {
+                    if (cqe.res == -EINVAL && multishot_accept)
+                    {
+                        multishot_accept = false; // pre-5.19 kernel, accept one at a time
+                    }
+                    else if (cqe.res >= 0)
+                    {
+                        if (listeners_[id].tcp)
+                        {
+                            int one = 1;
+                            setsockopt(cqe.res, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                        }
+                        uint64_t new_id = next_id++;
+                        conns[new_id].fd = cqe.res;
+                        arm_recv(new_id, cqe.res);
+                        std::cout << "Accepted connection (io_uring)" << std::endl;
+                    }
+
+                    if (!more && running_)
+                    {
+                        arm_accept(id);
+                    }
+                    break;
+                }
+                case OP_RECV:
+                {
+                    auto it = conns.find(id);
+                    if (it == conns.end())
+                    {
+                        break;
+                    }
+                    UringConn &conn = it->second;
+
+                    if (cqe.res > 0)
+                    {
+                        uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                        conn.input.append(ring.buffer(bid), cqe.res);
+                        ring.recycle_buffer(bid);
+
+                        size_t before = conn.output.size();
+                        consume_input(conn.input, conn.output, conn.session);
+                        if (conn.output.size() != before)
+                        {
+                            dirty.push_back(id);
+                        }
+
+                        if (conn.session.mailbox && !conn.watching_mailbox)
+                        {
+                            arm_notify(id, conn);
+                        }
+
+                        if (conn.session.blocked && conn.session.blocked->has_deadline && !conn.timer_armed)
+                        {
+                            arm_timer(id, conn);
+                        }
+
+                        if (conn.session.psync)
+                        {
+                            hand_off_replica(id, conn);
+                        }
+                        else if (!more)
+                        {
+                            arm_recv(id, conn.fd);
+                        }
+                    }
+                    else if (cqe.res == -ENOBUFS)
+                    {
+                        arm_recv(id, conn.fd); // buffers come back once replies are processed
+                    }
+                    else if (cqe.res == -EINVAL && multishot_recv)
+                    {
+                        multishot_recv = false; // pre-6.0 kernel, re-arm after every recv
+                        arm_recv(id, conn.fd);
+                    }
+                    else if (!more)
+                    {
+                        conn.recv_done = true; // EOF or error
+                        maybe_close(id);
+                    }
+                    break;
+                }
+                case OP_SEND:
+                {
+                    auto it = conns.find(id);
+                    if (it == conns.end())
+                    {
+                        break;
+                    }
+                    UringConn &conn = it->second;
+                    conn.sending = false;
+
+                    if (cqe.res < 0)
+                    {
+                        conn.recv_done = true;
+                        shutdown(conn.fd, SHUT_RDWR); // ends the multishot recv as well
+                        maybe_close(id);
+                        break;
+                    }
+
+                    conn.output.consume(cqe.res);
+                    if (!conn.output.empty())
+                    {
+                        dirty.push_back(id);
+                    }
+                    else
+                    {
+                        deliver(id, conn);
+                        maybe_close(id);
+                    }
+                    break;
+                }
+                case OP_NOTIFY:
+                {
+                    auto it = conns.find(id);
+                    if (it == conns.end() || cqe.res < 0)
+                    {
+                        break;
+                    }
+
+                    deliver(id, it->second);
+                    resume(id, it->second);
+                    arm_notify(id, it->second);
+                    break;
+                }
+                case OP_TIMER:
+                {
+                    // Fires at the deadline of the pop that armed it; a later pop re-arms
+                    auto it = conns.find(id);
+                    if (it == conns.end())
+                    {
+                        break;
+                    }
+
+                    it->second.timer_armed = false;
+                    resume(id, it->second);
+                    break;
+                }
+                case OP_WAKE:
+                    if (running_)
+                    {
+                        arm_wake();
+                    }
+                    break;
+                case OP_CANCEL:
+                    break;
+                }
+            });
+
+            // Batch: queue one send per connection with pending output, submitted together
+            for (uint64_t id : dirty)
+            {
+                auto it = conns.find(id);
+                if (it == conns.end() || it->second.sending)
+                {
+                    continue;
+                }
+
+                UringConn &conn = it->second;
+                if (!conn.output.empty())
+                {
+                    arm_send(id, conn);
+                }
+            }
+            dirty.clear();
+        }
+
+        for (auto &[id, conn] : conns)
+        {
+            close(conn.fd);
+        }
+
+        wake_fd_ = -1;
+        close(wake_fd);
+        return true;
+    }
+}
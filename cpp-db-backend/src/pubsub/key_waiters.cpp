@@ -0,0 +1,53 @@
+#include "pubsub/key_waiters.h"
+#include <algorithm>
+
+namespace kv
+{
+    void KeyWaiters::add(const std::string &key, const std::shared_ptr<Mailbox> &mailbox)
+    {
+        std::lock_guard lock(mutex_);
+        waiters_[key].push_back(mailbox);
+        count_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void KeyWaiters::remove(const std::string &key, const Mailbox *mailbox)
+    {
+        std::lock_guard lock(mutex_);
+        auto it = waiters_.find(key);
+        if (it == waiters_.end())
+        {
+            return;
+        }
+
+        auto &list = it->second;
+        auto end = std::remove_if(list.begin(), list.end(), [mailbox](const auto &m) { return m.get() == mailbox; });
+        count_.fetch_sub(list.end() - end, std::memory_order_relaxed);
+        list.erase(end, list.end());
+        if (list.empty())
+        {
+            waiters_.erase(it);
+        }
+    }
+
+    void KeyWaiters::signal(std::string_view key)
+    {
+        // A waiter registers before its last non-blocking attempt, so a write it could
+        // have missed always sees it here
+        if (count_.load(std::memory_order_seq_cst) == 0)
+        {
+            return;
+        }
+
+        std::lock_guard lock(mutex_);
+        auto it = waiters_.find(std::string(key));
+        if (it == waiters_.end())
+        {
+            return;
+        }
+
+        for (const auto &mailbox : it->second)
+        {
+            mailbox->notify();
+        }
+    }
+}
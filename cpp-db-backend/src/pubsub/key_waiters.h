@@ -0,0 +1,30 @@
+#pragma once
+#include "pubsub/mailbox.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace kv
+{
+    // Connections parked on keys by blocking commands (BZPOPMIN/BZPOPMAX).
+    // signal() only notifies the waiters' mailboxes; they retry the command on their own
+    // connection, so nothing blocks a thread and a lost race just leaves a waiter parked.
+    class KeyWaiters
+    {
+    public:
+        void add(const std::string &key, const std::shared_ptr<Mailbox> &mailbox);
+        void remove(const std::string &key, const Mailbox *mailbox);
+
+        // Wakes everyone waiting on key. A single atomic load when nobody waits at all.
+        void signal(std::string_view key);
+
+    private:
+        std::mutex mutex_;
+        std::unordered_map<std::string, std::vector<std::shared_ptr<Mailbox>>> waiters_;
+        std::atomic<size_t> count_{0};
+    };
+}
@@ -0,0 +1,120 @@
+#include "pubsub/mailbox.h"
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace kv
+{
+    namespace
+    {
+        int64_t now_ms()
+        {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    }
+
+    Mailbox::Mailbox(OutputLimits limits) : head_(new Node), limits_(limits)
+    {
+        tail_ = head_.load();
+
+        event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (event_fd_ < 0)
+        {
+            delete tail_;
+            throw std::runtime_error("Failed to create eventfd");
+        }
+    }
+
+    Mailbox::~Mailbox()
+    {
+        std::shared_ptr<const std::string> msg;
+        while (pop(msg))
+        {
+        }
+
+        delete tail_;
+        close(event_fd_);
+    }
+
+    bool Mailbox::within_limits(size_t pending)
+    {
+        if (pending > limits_.hard_bytes)
+        {
+            return false;
+        }
+
+        if (pending <= limits_.soft_bytes)
+        {
+            soft_since_ms_.store(0, std::memory_order_relaxed);
+            return true;
+        }
+
+        int64_t now = now_ms();
+        int64_t since = 0;
+        if (soft_since_ms_.compare_exchange_strong(since, now, std::memory_order_relaxed))
+        {
+            return true;
+        }
+
+        return now - since <= std::chrono::duration_cast<std::chrono::milliseconds>(limits_.soft_seconds).count();
+    }
+
+    bool Mailbox::push(std::shared_ptr<const std::string> msg)
+    {
+        if (overflowed())
+        {
+            return false;
+        }
+
+        size_t pending = pending_bytes_.fetch_add(msg->size(), std::memory_order_relaxed) + msg->size();
+        if (!within_limits(pending))
+        {
+            pending_bytes_.fetch_sub(msg->size(), std::memory_order_relaxed);
+            overflowed_.store(true, std::memory_order_release);
+            notify(); // the owner closes the connection
+            return false;
+        }
+
+        Node *node = new Node;
+        node->msg = std::move(msg);
+
+        Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+
+        notify();
+        return true;
+    }
+
+    void Mailbox::notify()
+    {
+        if (!notified_.exchange(true, std::memory_order_acq_rel))
+        {
+            uint64_t one = 1;
+            (void)write(event_fd_, &one, sizeof(one));
+        }
+    }
+
+    void Mailbox::clear_notification()
+    {
+        notified_.store(false, std::memory_order_release);
+
+        uint64_t value;
+        (void)read(event_fd_, &value, sizeof(value));
+    }
+
+    bool Mailbox::pop(std::shared_ptr<const std::string> &msg)
+    {
+        Node *next = tail_->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+        {
+            return false;
+        }
+
+        msg = std::move(next->msg);
+        pending_bytes_.fetch_sub(msg->size(), std::memory_order_relaxed);
+
+        delete tail_;
+        tail_ = next;
+        return true;
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace kv
+{
+    // Output-buffer limits for a subscriber, like Redis' client-output-buffer-limit:
+    // over hard_bytes, or over soft_bytes for longer than soft_seconds, it gets disconnected.
+    struct OutputLimits
+    {
+        size_t hard_bytes = 32 << 20;
+        size_t soft_bytes = 8 << 20;
+        std::chrono::seconds soft_seconds{60};
+    };
+
+    // Cross-thread inbox of one connection. Any thread may push (a lock-free MPSC queue);
+    // only the connection's owner pops. The owner watches fd(), an eventfd that is written
+    // at most once per batch of pushes, so publishers never block on a slow reader.
+    class Mailbox
+    {
+    public:
+        explicit Mailbox(OutputLimits limits = OutputLimits());
+        ~Mailbox();
+
+        Mailbox(const Mailbox &) = delete;
+        Mailbox &operator=(const Mailbox &) = delete;
+
+        int fd() const { return event_fd_; }
+
+        // Any thread. Returns false (dropping msg) once the owner is over its limits.
+        bool push(std::shared_ptr<const std::string> msg);
+
+        // Any thread: wake the owner without queueing anything
+        void notify();
+
+        // Owner only. Call before popping so a push racing with the drain re-signals fd().
+        void clear_notification();
+        bool pop(std::shared_ptr<const std::string> &msg);
+
+        bool overflowed() const { return overflowed_.load(std::memory_order_acquire); }
+        size_t pending_bytes() const { return pending_bytes_.load(std::memory_order_relaxed); }
+
+    private:
+        struct Node
+        {
+            std::shared_ptr<const std::string> msg;
+            std::atomic<Node *> next{nullptr};
+        };
+
+        bool within_limits(size_t pending);
+
+        std::atomic<Node *> head_; // producers swap themselves in here
+        Node *tail_;               // consumer side, always a drained node
+        std::atomic<size_t> pending_bytes_{0};
+        std::atomic<int64_t> soft_since_ms_{0};
+        std::atomic<bool> overflowed_{false};
+        std::atomic<bool> notified_{false};
+        int event_fd_;
+        OutputLimits limits_;
+    };
+}
@@ -0,0 +1,195 @@
+#include "pubsub/pubsub.h"
+#include "net/resp.h"
+#include <algorithm>
+
+namespace kv
+{
+    namespace
+    {
+        void add(std::unordered_map<std::string, std::vector<std::shared_ptr<Mailbox>>> &subs, const std::string &name, const std::shared_ptr<Mailbox> &mailbox)
+        {
+            subs[name].push_back(mailbox);
+        }
+
+        void remove(std::unordered_map<std::string, std::vector<std::shared_ptr<Mailbox>>> &subs, const std::string &name, const Mailbox *mailbox)
+        {
+            auto it = subs.find(name);
+            if (it == subs.end())
+            {
+                return;
+            }
+
+            auto &list = it->second;
+            list.erase(std::remove_if(list.begin(), list.end(), [mailbox](const auto &m) { return m.get() == mailbox; }), list.end());
+            if (list.empty())
+            {
+                subs.erase(it);
+            }
+        }
+
+        // Matches one [...] class at pattern[p] (just past the '['); advances p past the ']'
+        bool match_class(std::string_view pattern, size_t &p, char c)
+        {
+            bool negate = p < pattern.size() && pattern[p] == '^';
+            if (negate)
+            {
+                p++;
+            }
+
+            bool matched = false;
+            while (p < pattern.size() && pattern[p] != ']')
+            {
+                if (pattern[p] == '\\' && p + 1 < pattern.size())
+                {
+                    matched |= pattern[p + 1] == c;
+                    p += 2;
+                }
+                else if (p + 2 < pattern.size() && pattern[p + 1] == '-' && pattern[p + 2] != ']')
+                {
+                    char lo = std::min(pattern[p], pattern[p + 2]);
+                    char hi = std::max(pattern[p], pattern[p + 2]);
+                    matched |= c >= lo && c <= hi;
+                    p += 3;
+                }
+                else
+                {
+                    matched |= pattern[p] == c;
+                    p++;
+                }
+            }
+
+            if (p < pattern.size())
+            {
+                p++; // the ']'
+            }
+            return matched != negate;
+        }
+    }
+
+    bool glob_match(std::string_view pattern, std::string_view str)
+    {
+        // Greedy matching that backtracks only to the last '*'
+        size_t p = 0, s = 0;
+        size_t star_p = std::string_view::npos, star_s = 0;
+
+        while (s < str.size())
+        {
+            if (p < pattern.size() && pattern[p] == '*')
+            {
+                star_p = ++p;
+                star_s = s;
+                continue;
+            }
+
+            if (p < pattern.size())
+            {
+                size_t next = p;
+                bool ok;
+
+                if (pattern[p] == '?')
+                {
+                    ok = true;
+                    next = p + 1;
+                }
+                else if (pattern[p] == '[')
+                {
+                    next = p + 1;
+                    ok = match_class(pattern, next, str[s]);
+                }
+                else if (pattern[p] == '\\' && p + 1 < pattern.size())
+                {
+                    ok = pattern[p + 1] == str[s];
+                    next = p + 2;
+                }
+                else
+                {
+                    ok = pattern[p] == str[s];
+                    next = p + 1;
+                }
+
+                if (ok)
+                {
+                    p = next;
+                    s++;
+                    continue;
+                }
+            }
+
+            if (star_p == std::string_view::npos)
+            {
+                return false;
+            }
+            p = star_p;
+            s = ++star_s;
+        }
+
+        while (p < pattern.size() && pattern[p] == '*')
+        {
+            p++;
+        }
+        return p == pattern.size();
+    }
+
+    PubSub::PubSub() : registry_(std::make_shared<const Registry>()) {}
+
+    template <typename Fn>
+    void PubSub::update(Fn &&fn)
+    {
+        std::lock_guard lock(update_mutex_);
+        auto next = std::make_shared<Registry>(*std::atomic_load(&registry_));
+        fn(*next);
+        std::atomic_store(&registry_, std::shared_ptr<const Registry>(std::move(next)));
+    }
+
+    void PubSub::subscribe(const std::string &channel, const std::shared_ptr<Mailbox> &mailbox)
+    {
+        update([&](Registry &r) { add(r.channels, channel, mailbox); });
+    }
+
+    void PubSub::unsubscribe(const std::string &channel, const Mailbox *mailbox)
+    {
+        update([&](Registry &r) { remove(r.channels, channel, mailbox); });
+    }
+
+    void PubSub::psubscribe(const std::string &pattern, const std::shared_ptr<Mailbox> &mailbox)
+    {
+        update([&](Registry &r) { add(r.patterns, pattern, mailbox); });
+    }
+
+    void PubSub::punsubscribe(const std::string &pattern, const Mailbox *mailbox)
+    {
+        update([&](Registry &r) { remove(r.patterns, pattern, mailbox); });
+    }
+
+    size_t PubSub::publish(const std::string &channel, const std::string &message)
+    {
+        auto registry = std::atomic_load(&registry_);
+        size_t receivers = 0;
+
+        auto it = registry->channels.find(channel);
+        if (it != registry->channels.end())
+        {
+            auto encoded = std::make_shared<const std::string>(encode_array({"message", channel, message}));
+            for (const auto &mailbox : it->second)
+            {
+                receivers += mailbox->push(encoded);
+            }
+        }
+
+        for (const auto &[pattern, mailboxes] : registry->patterns)
+        {
+            if (!glob_match(pattern, channel))
+            {
+                continue;
+            }
+
+            auto encoded = std::make_shared<const std::string>(encode_array({"pmessage", pattern, channel, message}));
+            for (const auto &mailbox : mailboxes)
+            {
+                receivers += mailbox->push(encoded);
+            }
+        }
+
+        return receivers;
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "pubsub/mailbox.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace kv
+{
+    // Redis-style glob: *, ?, [abc], [a-z], [^a] and \ escapes
+    bool glob_match(std::string_view pattern, std::string_view str);
+
+    // Channel and pattern subscriptions.
+    // The registry is copy-on-write: subscribe/unsubscribe build a new map under a mutex and
+    // swap it in, while publish only loads the current snapshot, so PUBLISH never takes a lock
+    // and never waits on a subscriber. Each message is encoded once and the same buffer is
+    // queued on every receiving mailbox.
+    class PubSub
+    {
+    public:
+        PubSub();
+
+        void subscribe(const std::string &channel, const std::shared_ptr<Mailbox> &mailbox);
+        void unsubscribe(const std::string &channel, const Mailbox *mailbox);
+        void psubscribe(const std::string &pattern, const std::shared_ptr<Mailbox> &mailbox);
+        void punsubscribe(const std::string &pattern, const Mailbox *mailbox);
+
+        // Returns how many subscribers the message was queued for
+        size_t publish(const std::string &channel, const std::string &message);
+
+    private:
+        using Subscribers = std::unordered_map<std::string, std::vector<std::shared_ptr<Mailbox>>>;
+
+        struct Registry
+        {
+            Subscribers channels;
+            Subscribers patterns;
+        };
+
+        template <typename Fn>
+        void update(Fn &&fn);
+
+        std::shared_ptr<const Registry> registry_; // accessed with std::atomic_load/atomic_store
+        std::mutex update_mutex_;
+    };
+}
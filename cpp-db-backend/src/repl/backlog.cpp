@@ -0,0 +1,70 @@
+#include "repl/backlog.h"
+#include <algorithm>
+
+namespace kv
+{
+    ReplicationBacklog::ReplicationBacklog(size_t capacity) : buf_(capacity) {}
+
+    void ReplicationBacklog::append(const std::string &data)
+    {
+        {
+            std::lock_guard lock(mutex_);
+            size_t cap = buf_.size();
+            const char *src = data.data();
+            size_t len = data.size();
+
+            // Only the tail of an oversized write can survive
+            if (len > cap)
+            {
+                src += len - cap;
+                end_ += len - cap;
+                len = cap;
+            }
+
+            size_t pos = end_ % cap;
+            size_t first = std::min(len, cap - pos);
+            std::copy(src, src + first, buf_.begin() + pos);
+            std::copy(src + first, src + len, buf_.begin());
+            end_ += len;
+        }
+        cv_.notify_all();
+    }
+
+    uint64_t ReplicationBacklog::end_offset() const
+    {
+        std::lock_guard lock(mutex_);
+        return end_;
+    }
+
+    bool ReplicationBacklog::contains(uint64_t offset) const
+    {
+        std::lock_guard lock(mutex_);
+        return contains_locked(offset);
+    }
+
+    bool ReplicationBacklog::contains_locked(uint64_t offset) const
+    {
+        uint64_t start = end_ > buf_.size() ? end_ - buf_.size() : 0;
+        return offset >= start && offset <= end_;
+    }
+
+    bool ReplicationBacklog::read(uint64_t offset, std::string &out, size_t max_bytes, std::chrono::milliseconds wait) const
+    {
+        std::unique_lock lock(mutex_);
+        cv_.wait_for(lock, wait, [&] { return end_ != offset; });
+
+        if (!contains_locked(offset))
+        {
+            return false;
+        }
+
+        size_t cap = buf_.size();
+        size_t len = std::min<uint64_t>(end_ - offset, max_bytes);
+        size_t pos = offset % cap;
+        size_t first = std::min(len, cap - pos);
+
+        out.assign(buf_.begin() + pos, buf_.begin() + pos + first);
+        out.append(buf_.begin(), buf_.begin() + (len - first));
+        return true;
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace kv
+{
+    // Fixed-size ring of the most recent replication stream bytes.
+    // Offsets count every byte ever appended, so a replica that reconnects with the
+    // offset it reached can resume as long as that offset is still inside the ring.
+    class ReplicationBacklog
+    {
+    public:
+        explicit ReplicationBacklog(size_t capacity = 1 << 20);
+
+        // Nothing is recorded until the first replica asks for a sync
+        void enable() { enabled_.store(true, std::memory_order_release); }
+        bool enabled() const { return enabled_.load(std::memory_order_acquire); }
+
+        void append(const std::string &data);
+
+        // Offset one past the last byte appended
+        uint64_t end_offset() const;
+
+        // True if every byte from offset onwards is still held
+        bool contains(uint64_t offset) const;
+
+        // Copies bytes from offset (at most max_bytes) into out, waiting up to `wait` for new data.
+        // Returns false if offset has already been overwritten.
+        bool read(uint64_t offset, std::string &out, size_t max_bytes, std::chrono::milliseconds wait) const;
+
+    private:
+        bool contains_locked(uint64_t offset) const;
+
+        mutable std::mutex mutex_;
+        mutable std::condition_variable cv_;
+        std::vector<char> buf_;
+        uint64_t end_ = 0;
+        std::atomic<bool> enabled_{false};
+    };
+}
@@ -0,0 +1,53 @@
+#include "net/arena.h"
+#include "net/resp.h"
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+int main() {
+    kv::Arena arena(256);
+
+    // Test 1: Allocations are aligned and don't overlap
+    std::cout << "Test 1: Bump allocation...\n";
+    char* a = static_cast<char*>(arena.allocate(3, 1));
+    auto* b = static_cast<uint64_t*>(arena.allocate(sizeof(uint64_t), alignof(uint64_t)));
+    assert(reinterpret_cast<uintptr_t>(b) % alignof(uint64_t) == 0);
+    assert(reinterpret_cast<char*>(b) >= a + 3);
+    void* big = arena.allocate(10000, 16); // bigger than a chunk gets its own
+    assert(big != nullptr && reinterpret_cast<uintptr_t>(big) % 16 == 0);
+    std::cout << "✓ Aligned, including oversized requests\n";
+
+    // Test 2: Rewinding reuses the chunks instead of allocating new ones
+    std::cout << "\nTest 2: Rewind...\n";
+    size_t chunks = 0;
+    for (int round = 0; round < 10; round++) {
+        kv::ArenaScope scope(arena);
+        for (int i = 0; i < 100; i++) {
+            arena.allocate(200, 8);
+        }
+        if (round == 0) {
+            chunks = arena.chunks();
+        }
+        assert(arena.chunks() == chunks);
+    }
+    std::cout << "✓ Steady state needs no new chunks\n";
+
+    // Test 3: Containers and the command splitter on top of it
+    std::cout << "\nTest 3: ArenaVector and split_command...\n";
+    {
+        kv::ArenaScope scope(arena);
+        kv::ArenaVector<std::string> args(arena);
+        kv::split_command("  ZADD\tboard 1.5  a_member_name_longer_than_sso \r", args);
+        assert(args.size() == 4);
+        assert(args[0] == "ZADD" && args[1] == "board" && args[2] == "1.5");
+        assert(args[3] == "a_member_name_longer_than_sso");
+        kv::ArenaVector<std::string> none(arena);
+        kv::split_command(" \t ", none);
+        assert(none.empty());
+    }
+    std::cout << "✓ Splits on any whitespace like the old istringstream parser\n";
+
+    std::cout << "\n✅ All Arena tests passed!\n";
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include "repl/backlog.h"
+#include <cassert>
+#include <chrono>
+#include <iostream>
+
+int main() {
+    using namespace std::chrono_literals;
+    kv::ReplicationBacklog backlog(16);
+    std::string out;
+
+    // Test 1: Append and read from the start
+    std::cout << "Test 1: Append and read...\n";
+    backlog.append("SET a 1\n");
+    assert(backlog.end_offset() == 8);
+    assert(backlog.read(0, out, 100, 0ms));
+    assert(out == "SET a 1\n");
+    assert(backlog.read(4, out, 100, 0ms));
+    assert(out == "a 1\n");
+    std::cout << "✓ Read from offset works\n";
+
+    // Test 2: Wrap around the ring
+    std::cout << "\nTest 2: Wraparound...\n";
+    backlog.append("SET b 22\n"); // end = 17, window is [1, 17)
+    assert(!backlog.contains(0));
+    assert(backlog.contains(1));
+    assert(backlog.read(8, out, 100, 0ms));
+    assert(out == "SET b 22\n");
+    assert(!backlog.read(0, out, 100, 0ms));
+    std::cout << "✓ Old offsets drop out of the window\n";
+
+    // Test 3: max_bytes and caught-up reads
+    std::cout << "\nTest 3: Partial and empty reads...\n";
+    assert(backlog.read(8, out, 3, 0ms));
+    assert(out == "SET");
+    assert(backlog.read(17, out, 100, 1ms));
+    assert(out.empty());
+    std::cout << "✓ Partial and empty reads work\n";
+
+    // Test 4: Oversized append keeps only the tail
+    std::cout << "\nTest 4: Oversized append...\n";
+    backlog.append("0123456789abcdefXYZ");
+    assert(backlog.end_offset() == 36);
+    assert(backlog.read(20, out, 100, 0ms));
+    assert(out == "3456789abcdefXYZ");
+    std::cout << "✓ Oversized append keeps the newest bytes\n";
+
+    std::cout << "\n✅ All backlog tests passed!\n";
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include "kv/bloom_filter.h"
+#include <cassert>
+#include <iostream>
+#include <string>
+
+int main() {
+    // Test 1: Added items are always found
+    std::cout << "Test 1: No false negatives...\n";
+    kv::BloomFilter filter(10000, 0.01);
+    assert(!filter.contains("a"));
+    assert(filter.add("a"));
+    assert(!filter.add("a")); // already present
+    assert(filter.contains("a"));
+    for (int i = 0; i < 10000; i++) {
+        filter.add("item" + std::to_string(i));
+    }
+    for (int i = 0; i < 10000; i++) {
+        assert(filter.contains("item" + std::to_string(i)));
+    }
+    std::cout << "✓ Every added item is found\n";
+
+    // Test 2: False positive rate near the target at capacity
+    std::cout << "\nTest 2: False positive rate...\n";
+    int false_positives = 0;
+    for (int i = 0; i < 100000; i++) {
+        false_positives += filter.contains("other" + std::to_string(i));
+    }
+    double rate = false_positives / 100000.0;
+    std::cout << "  rate " << rate << " in " << filter.bytes() << " bytes\n";
+    assert(rate < 0.02);
+    assert(filter.bytes() < 16 * 1024);
+    std::cout << "✓ Under twice the requested error rate\n";
+
+    // Test 3: Serialization round-trips and rejects garbage
+    std::cout << "\nTest 3: Serialization...\n";
+    auto copy = kv::BloomFilter::deserialize(filter.serialize());
+    assert(copy && copy->bytes() == filter.bytes());
+    assert(copy->contains("item42") && copy->contains("a"));
+    assert(copy->serialize() == filter.serialize());
+    assert(!kv::BloomFilter::deserialize("B"));
+    assert(!kv::BloomFilter::deserialize("Bxyz"));
+    assert(!kv::BloomFilter::deserialize("S"));
+    std::cout << "✓ Filters round-trip\n";
+
+    std::cout << "\n✅ All Bloom filter tests passed!\n";
+    return 0;
+}
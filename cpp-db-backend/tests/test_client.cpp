@@ -0,0 +1,274 @@
+#include "client/client.h"
+#include "net/resp.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    // Stand-in server on a loopback port. Replies per line:
+    //   ECHO x -> bulk x, NUM n -> integer, ARR a b.. -> array, NIL -> null,
+    //   CLOSE -> drops the connection, anything else -> +OK.
+    // Replies go out one byte at a time when the line starts with SLOW, to split them.
+    class FakeServer {
+    public:
+        FakeServer() {
+            listener_ = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            int bound = bind(listener_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+            int listening = listen(listener_, 16);
+            assert(bound == 0 && listening == 0);
+            socklen_t len = sizeof(addr);
+            getsockname(listener_, reinterpret_cast<sockaddr*>(&addr), &len);
+            port_ = ntohs(addr.sin_port);
+            acceptor_ = std::thread([this] {
+                int sock;
+                while ((sock = accept(listener_, nullptr, nullptr)) >= 0) {
+                    accepted_++;
+                    std::thread(&FakeServer::serve, sock).detach();
+                }
+            });
+        }
+
+        ~FakeServer() {
+            shutdown(listener_, SHUT_RDWR);
+            acceptor_.join();
+            close(listener_);
+        }
+
+        int port() const { return port_; }
+        int accepted() const { return accepted_; }
+
+    private:
+        static void serve(int sock) {
+            std::string buffer;
+            char chunk[4096];
+            ssize_t n;
+            while ((n = recv(sock, chunk, sizeof(chunk), 0)) > 0) {
+                buffer.append(chunk, n);
+                size_t end;
+                std::string out;
+                while ((end = buffer.find("\r\n")) != std::string::npos) {
+                    std::string line = buffer.substr(0, end);
+                    buffer.erase(0, end + 2);
+                    bool slow = line.rfind("SLOW ", 0) == 0;
+                    if (slow) {
+                        line.erase(0, 5);
+                    }
+
+                    std::vector<std::string> args;
+                    for (size_t pos = 0; pos < line.size();) {
+                        size_t space = line.find(' ', pos);
+                        args.push_back(line.substr(pos, space - pos));
+                        pos = space == std::string::npos ? line.size() : space + 1;
+                    }
+
+                    std::string reply;
+                    if (args[0] == "CLOSE") {
+                        close(sock);
+                        return;
+                    } else if (args[0] == "ECHO") {
+                        reply = kv::encode_bulk_string(args[1]);
+                    } else if (args[0] == "NUM") {
+                        reply = kv::encode_integer(std::stoll(args[1]));
+                    } else if (args[0] == "ARR") {
+                        reply = kv::encode_array(std::vector<std::string>(args.begin() + 1, args.end()));
+                    } else if (args[0] == "NIL") {
+                        reply = kv::encode_null_bulk_string();
+                    } else {
+                        reply = kv::encode_simple_string("OK");
+                    }
+
+                    if (slow) {
+                        send(sock, out.data(), out.size(), MSG_NOSIGNAL);
+                        out.clear();
+                        for (char c : reply) {
+                            send(sock, &c, 1, MSG_NOSIGNAL);
+                        }
+                    } else {
+                        out += reply;
+                    }
+                }
+                send(sock, out.data(), out.size(), MSG_NOSIGNAL);
+            }
+            close(sock);
+        }
+
+        int listener_;
+        int port_;
+        std::atomic<int> accepted_{0};
+        std::thread acceptor_;
+    };
+}
+
+int main() {
+    // Test 1: Every reply type, and no reply until the last byte is in
+    std::cout << "Test 1: Parsing replies...\n";
+    std::string wire = "*4\r\n+OK\r\n:-42\r\n$5\r\nhe\r\no\r\n*2\r\n$-1\r\n-ERR boom\r\n";
+    kv::Reply reply;
+    for (size_t len = 0; len < wire.size(); len++) {
+        assert(kv::parse_reply(std::string_view(wire).substr(0, len), reply) == 0);
+    }
+    assert(kv::parse_reply(wire + "+next\r\n", reply) == wire.size());
+    assert(reply.type == kv::Reply::Type::Array && reply.elements.size() == 4);
+    assert(reply.elements[0].type == kv::Reply::Type::Status && reply.elements[0].str == "OK");
+    assert(reply.elements[1].type == kv::Reply::Type::Integer && reply.elements[1].integer == -42);
+    assert(reply.elements[2].type == kv::Reply::Type::Bulk && reply.elements[2].str == "he\r\no");
+    assert(reply.elements[3].elements[0].type == kv::Reply::Type::Null);
+    assert(reply.elements[3].elements[1].is_error() && reply.elements[3].elements[1].str == "ERR boom");
+    for (std::string bad : {"?x\r\n", ":12a\r\n", "$2\r\nabcd\r\n", "\r\n"}) {
+        bool threw = false;
+        try {
+            kv::parse_reply(bad, reply);
+        } catch (const kv::ProtocolError&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+    std::cout << "✓ Status, error, integer, bulk, null and nested arrays\n";
+
+    // Test 2: Commands go out as inline lines
+    std::cout << "\nTest 2: Encoding commands...\n";
+    assert(kv::encode_command({"SET", "k", "v"}) == "SET k v\r\n");
+    for (const auto& args : std::vector<std::vector<std::string>>{{}, {"SET", "", "v"}, {"SET", "k", "a b"}}) {
+        bool threw = false;
+        try {
+            kv::encode_command(args);
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+    std::cout << "✓ Arguments with whitespace are refused\n";
+
+    FakeServer server;
+    kv::ClientOptions options;
+    options.port = server.port();
+    options.connections = 1;
+
+    // Test 3: Futures and callbacks, with replies split across reads
+    std::cout << "\nTest 3: Futures and callbacks...\n";
+    {
+        kv::Client client(options);
+        assert(client.call({"PING"}).str == "OK");
+        assert(client.call({"NUM", "7"}).integer == 7);
+        assert(client.call({"NIL"}).type == kv::Reply::Type::Null);
+        assert(client.call({"SLOW", "ARR", "a", "bc"}).elements[1].str == "bc");
+
+        std::atomic<int> called{0};
+        client.send({"ECHO", "cb"}, [&called](kv::Reply reply) {
+            assert(reply.str == "cb");
+            called++;
+        });
+        assert(client.call({"ECHO", "after"}).str == "after");
+        assert(called == 1); // replies complete in order
+    }
+    std::cout << "✓ Replies reach the right caller\n";
+
+    // Test 4: Concurrent callers share one socket
+    std::cout << "\nTest 4: Pipelining concurrent requests...\n";
+    {
+        kv::Client client(options);
+        client.call({"PING"}); // accepted by now
+        int before = server.accepted();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 8; t++) {
+            threads.emplace_back([&client, t] {
+                std::vector<std::future<kv::Reply>> futures;
+                for (int i = 0; i < 500; i++) {
+                    futures.push_back(client.send({"ECHO", std::to_string(t) + ":" + std::to_string(i)}));
+                }
+                for (int i = 0; i < 500; i++) {
+                    assert(futures[i].get().str == std::to_string(t) + ":" + std::to_string(i));
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        assert(server.accepted() == before);
+    }
+    std::cout << "✓ 4000 requests from 8 threads, one connection\n";
+
+    // Test 5: Batches go out together; MULTI must be closed within one
+    std::cout << "\nTest 5: Batches...\n";
+    {
+        kv::Client client(options);
+        kv::Batch batch;
+        auto multi = batch.add({"MULTI"});
+        batch.add({"ECHO", "queued"}, nullptr);
+        auto exec = batch.add({"EXEC"});
+        assert(batch.size() == 3);
+        client.execute(batch);
+        assert(batch.empty());
+        assert(multi.get().str == "OK" && exec.get().str == "OK");
+
+        bool threw = false;
+        batch.add({"MULTI"});
+        try {
+            client.execute(batch);
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        assert(threw);
+
+        for (const auto& args : std::vector<std::vector<std::string>>{{"MULTI"}, {"SUBSCRIBE", "news"}}) {
+            threw = false;
+            try {
+                client.send(args);
+            } catch (const std::invalid_argument&) {
+                threw = true;
+            }
+            assert(threw);
+        }
+    }
+    std::cout << "✓ MULTI ... EXEC only inside one batch\n";
+
+    // Test 6: A dropped connection fails what was outstanding, then reconnects
+    std::cout << "\nTest 6: Connection loss...\n";
+    {
+        kv::Client client(options);
+        auto closed = client.send({"CLOSE"});
+        kv::Reply lost = closed.get();
+        assert(lost.is_error() && lost.str.rfind("IOERR", 0) == 0);
+        assert(client.call({"ECHO", "back"}).str == "back");
+    }
+    std::cout << "✓ IOERR, then a fresh connection\n";
+
+    // Test 7: Retrying from the IOERR callback replaces the connection that is running it
+    std::cout << "\nTest 7: Retry from a callback...\n";
+    {
+        kv::Client client(options);
+        std::promise<kv::Reply> retried;
+        auto retry = retried.get_future();
+        client.send({"CLOSE"}, [&client, &retried](kv::Reply reply) {
+            assert(reply.is_error());
+            client.send({"ECHO", "retry"}, [&retried](kv::Reply reply) { retried.set_value(std::move(reply)); });
+        });
+        assert(retry.get().str == "retry");
+        assert(client.call({"ECHO", "after"}).str == "after");
+    }
+    std::cout << "✓ The retry goes out on a fresh connection\n";
+
+    bool refused = false;
+    try {
+        kv::ClientOptions nowhere;
+        nowhere.unix_path = "/nonexistent/kv.sock";
+        kv::Client client(nowhere);
+    } catch (const std::system_error&) {
+        refused = true;
+    }
+    assert(refused);
+
+    std::cout << "\nAll client tests passed!\n";
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include "kv/hash.h"
+#include <cassert>
+#include <iostream>
+#include <string>
+
+int main() {
+    kv::Hash hash;
+
+    // Test 1: Set and get in the packed encoding
+    std::cout << "Test 1: Packed set/get...\n";
+    assert(hash.set("name", "alice"));
+    assert(hash.set("age", "30"));
+    assert(!hash.set("age", "31"));  // overwrite, not new
+    assert(hash.get("name").value() == "alice");
+    assert(hash.get("age").value() == "31");
+    assert(!hash.get("missing").has_value());
+    assert(hash.size() == 2);
+    assert(hash.is_packed());
+    std::cout << "✓ Packed set/get works\n";
+
+    // Test 2: Overwrite with a different length keeps neighbours intact
+    std::cout << "\nTest 2: Resizing values...\n";
+    assert(hash.set("city", "x"));
+    assert(!hash.set("age", "a much longer value than before"));
+    assert(hash.get("name").value() == "alice");
+    assert(hash.get("age").value() == "a much longer value than before");
+    assert(hash.get("city").value() == "x");
+    std::cout << "✓ In-place value resize works\n";
+
+    // Test 3: Remove
+    std::cout << "\nTest 3: Remove...\n";
+    assert(hash.remove("age"));
+    assert(!hash.remove("age"));
+    assert(hash.size() == 2);
+    assert(hash.all().size() == 2);
+    assert(hash.get("city").value() == "x");
+    std::cout << "✓ Remove works\n";
+
+    // Test 4: Long values promote to the table
+    std::cout << "\nTest 4: Promotion by length...\n";
+    assert(hash.set("bio", std::string(kv::Hash::kMaxPackedLength + 1, 'b')));
+    assert(!hash.is_packed());
+    assert(hash.get("name").value() == "alice");
+    assert(hash.get("bio").value().size() == kv::Hash::kMaxPackedLength + 1);
+    assert(hash.size() == 3);
+    std::cout << "✓ Promotion by length works\n";
+
+    // Test 5: Many fields promote to the table
+    std::cout << "\nTest 5: Promotion by count...\n";
+    kv::Hash big;
+    for (size_t i = 0; i < kv::Hash::kMaxPackedEntries; i++) {
+        assert(big.set("f" + std::to_string(i), std::to_string(i)));
+    }
+    assert(big.is_packed());
+    assert(big.set("one-more", "x"));
+    assert(!big.is_packed());
+    assert(big.size() == kv::Hash::kMaxPackedEntries + 1);
+    assert(big.get("f77").value() == "77");
+    std::cout << "✓ Promotion by count works\n";
+
+    std::cout << "\n✅ All Hash tests passed!\n";
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include "kv/hot_keys.h"
+#include "kv/kvstore.h"
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <thread>
+
+int main() {
+    // Test 1: A skewed key stands out of a uniform background
+    std::cout << "Test 1: Tracker finds the hot key...\n";
+    kv::HotKeys tracker;
+    for (int i = 0; i < 200000; i++) {
+        tracker.record(i % 2 == 0 ? "viral" : "key" + std::to_string(i % 5000));
+        if (i % 10 == 0) {
+            tracker.record("warm");
+        }
+    }
+    auto top = tracker.top(2);
+    assert(top.size() == 2);
+    assert(top[0].first == "viral" && top[1].first == "warm");
+    assert(top[0].second > 50000 && top[0].second <= 100000 + 100000 / 16);
+    assert(tracker.is_hot("viral") && tracker.is_hot("warm"));
+    assert(!tracker.is_hot("key42"));
+    std::cout << "✓ viral ~" << top[0].second << " reads, warm ~" << top[1].second << "\n";
+
+    // Test 2: Counts halve every decay window, so a key that stops being read cools off
+    std::cout << "\nTest 2: Decay...\n";
+    uint64_t before = top[0].second;
+    for (int i = 0; i < 16 * (1 << 17); i++) {
+        tracker.record("key" + std::to_string(i % 100000));
+    }
+    top = tracker.top(1);
+    assert(top[0].first == "viral" && top[0].second <= before / 4);
+    std::cout << "✓ viral down to ~" << top[0].second << " reads\n";
+
+    // Test 3: Cached GETs see every later write
+    std::cout << "\nTest 3: Store cache invalidation...\n";
+    kv::KVStore store;
+    store.enable_hot_key_cache();
+    store.set("viral", "v0");
+    for (int i = 0; i < 20000; i++) {
+        assert(store.get("viral").value() == "v0");
+    }
+    assert(!store.hot_keys(1).empty() && store.hot_keys(1)[0].first == "viral");
+
+    std::thread writer([&store]() { store.set("viral", "v1"); });
+    writer.join();
+    assert(store.get("viral").value() == "v1");
+
+    store.atomically({"viral"}, [&store]() {
+        store.set("viral", "v2");
+        assert(store.get("viral").value() == "v2"); // a transaction sees its own write
+    });
+    assert(store.get("viral").value() == "v2");
+
+    std::thread deleter([&store]() { store.del("viral"); });
+    deleter.join();
+    assert(!store.get("viral").has_value());
+
+    store.setWithTTL("viral", "short", std::chrono::seconds(0));
+    assert(!store.get("viral").has_value()); // expired keys are never served from the cache
+    std::cout << "✓ Writes, transactions and deletes invalidate cached values\n";
+
+    std::cout << "\n✅ All hot key tests passed!\n";
+    return 0;
+}
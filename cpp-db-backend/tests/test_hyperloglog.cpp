@@ -0,0 +1,74 @@
+#include "kv/hyperloglog.h"
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+namespace {
+    // Within a few standard errors (~0.81% each) of the true count
+    bool close(uint64_t estimate, uint64_t actual, double tolerance = 0.03) {
+        return std::fabs(double(estimate) - double(actual)) <= tolerance * double(actual) + 1;
+    }
+}
+
+int main() {
+    // Test 1: Empty and small counts in the sparse encoding
+    std::cout << "Test 1: Sparse counts...\n";
+    kv::HyperLogLog hll;
+    assert(hll.count() == 0);
+    assert(hll.add("a"));
+    assert(!hll.add("a")); // same register, same rank
+    assert(hll.add("b"));
+    assert(hll.count() == 2);
+    for (int i = 0; i < 500; i++) {
+        hll.add("user" + std::to_string(i));
+    }
+    assert(hll.is_sparse());
+    assert(close(hll.count(), 502));
+    std::cout << "✓ Small cardinalities are exact or close\n";
+
+    // Test 2: Promotion to dense and large counts
+    std::cout << "\nTest 2: Dense counts...\n";
+    for (int i = 500; i < 200000; i++) {
+        hll.add("user" + std::to_string(i));
+    }
+    assert(!hll.is_sparse());
+    assert(close(hll.count(), 200002));
+    std::cout << "✓ Estimate within 3% after promotion\n";
+
+    // Test 3: Merges across encodings count the union
+    std::cout << "\nTest 3: Merge...\n";
+    kv::HyperLogLog a, b, small;
+    for (int i = 0; i < 100000; i++) {
+        a.add("x" + std::to_string(i));
+        b.add("x" + std::to_string(i + 50000));
+    }
+    small.add("x1");
+    small.add("only-small");
+    kv::HyperLogLog u = a;
+    u.merge(b);       // dense into dense
+    u.merge(small);   // sparse into dense
+    assert(close(u.count(), 150001));
+    small.merge(a);   // dense into sparse promotes
+    assert(!small.is_sparse());
+    assert(close(small.count(), 100001));
+    std::cout << "✓ Register-wise max counts the union\n";
+
+    // Test 4: Serialization round-trips both encodings and rejects garbage
+    std::cout << "\nTest 4: Serialization...\n";
+    kv::HyperLogLog sparse;
+    sparse.add("p");
+    sparse.add("q");
+    auto sparse_copy = kv::HyperLogLog::deserialize(sparse.serialize());
+    assert(sparse_copy && sparse_copy->is_sparse() && sparse_copy->count() == 2);
+    assert(sparse.serialize().size() == 1 + 3 * 2);
+    auto dense_copy = kv::HyperLogLog::deserialize(u.serialize());
+    assert(dense_copy && dense_copy->count() == u.count());
+    assert(!kv::HyperLogLog::deserialize(""));
+    assert(!kv::HyperLogLog::deserialize("D123"));
+    assert(!kv::HyperLogLog::deserialize("S\x01\x02"));
+    std::cout << "✓ Sparse and dense encodings round-trip\n";
+
+    std::cout << "\n✅ All HyperLogLog tests passed!\n";
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "kv/key_index.h"
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+    std::vector<std::string> contents(const kv::KeyIndex &index) {
+        std::vector<std::string> keys;
+        for (auto cursor = index.begin(); cursor.valid(); cursor.next()) {
+            keys.push_back(cursor.key());
+        }
+        return keys;
+    }
+}
+
+int main() {
+    // Test 1: Basic insert/erase/lookups
+    std::cout << "Test 1: Basic operations...\n";
+    kv::KeyIndex index;
+    assert(!index.begin().valid());
+    assert(index.insert("b") && index.insert("a") && index.insert("c"));
+    assert(!index.insert("b"));
+    assert(index.size() == 3 && index.contains("a") && !index.contains("d"));
+    assert((contents(index) == std::vector<std::string>{"a", "b", "c"}));
+    assert(index.seek("b").key() == "b");
+    assert(index.seek("b", true).key() == "c");
+    assert(index.seek("bb").key() == "c");
+    assert(!index.seek("c", true).valid());
+    assert(index.erase("b") && !index.erase("b"));
+    assert(index.size() == 2);
+    std::cout << "✓ Insert, erase and seek work\n";
+
+    // Test 2: Many keys split and rebalance the tree, matching std::set throughout
+    std::cout << "\nTest 2: Random operations against std::set...\n";
+    kv::KeyIndex tree;
+    std::set<std::string> reference;
+    std::mt19937 rng(7);
+    for (int round = 0; round < 200000; round++) {
+        std::string key = "key:" + std::to_string(rng() % 20000);
+        if (rng() % 3 != 0) {
+            assert(tree.insert(key) == reference.insert(key).second);
+        } else {
+            assert(tree.erase(key) == (reference.erase(key) > 0));
+        }
+    }
+    assert(tree.size() == reference.size());
+    assert(contents(tree) == std::vector<std::string>(reference.begin(), reference.end()));
+    assert(tree.height() >= 3);
+    for (int i = 0; i < 1000; i++) {
+        std::string probe = "key:" + std::to_string(rng() % 25000);
+        auto expected = reference.lower_bound(probe);
+        auto cursor = tree.seek(probe);
+        assert(cursor.valid() == (expected != reference.end()));
+        if (cursor.valid()) {
+            assert(cursor.key() == *expected);
+        }
+        expected = reference.upper_bound(probe);
+        cursor = tree.seek(probe, true);
+        assert(cursor.valid() == (expected != reference.end()));
+        if (cursor.valid()) {
+            assert(cursor.key() == *expected);
+        }
+    }
+    std::cout << "✓ " << tree.size() << " keys in order, height " << tree.height() << "\n";
+
+    // Test 3: Erasing everything shrinks the tree back to one leaf
+    std::cout << "\nTest 3: Erase all...\n";
+    for (const auto &key : reference) {
+        assert(tree.erase(key));
+    }
+    assert(tree.size() == 0 && tree.height() == 1 && !tree.begin().valid());
+    tree.insert("again");
+    assert((contents(tree) == std::vector<std::string>{"again"}));
+    std::cout << "✓ Tree collapses and is reusable\n";
+
+    std::cout << "\n✅ All key index tests passed!\n";
+    return 0;
+}
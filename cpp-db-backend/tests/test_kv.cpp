@@ -16,6 +16,219 @@ int main() {
     assert(!store.exists("foo"));
     assert(!store.get("foo").has_value());
 
+    // Calls inside atomically() reuse the batch's shard locks instead of deadlocking
+    store.atomically({"a", "b"}, [&] {
+        store.set("a", "1");
+        store.zadd("b", "m", 2.0);
+        assert(store.get("a").value() == "1");
+    });
+    assert(store.zscore("b", "m").value() == 2.0);
+
+    store.atomically_all([&] {
+        assert(store.all_entries().size() == 2);
+    });
+
+    // One keyspace: a key has exactly one type
+    store.clear();
+    assert(store.type("k") == "none");
+    assert(store.zadd("k", "m", 1.0));
+    assert(store.type("k") == "zset");
+    assert(store.exists("k"));
+    bool threw = false;
+    try {
+        store.get("k");
+    } catch (const kv::WrongTypeError&) {
+        threw = true;
+    }
+    assert(threw);
+
+    // Emptied collections disappear, and ZREM on a missing key creates nothing
+    assert(store.zrem("k", "m"));
+    assert(!store.exists("k"));
+    assert(!store.zrem("missing", "m"));
+    assert(!store.exists("missing"));
+
+    // Multi-pair ZADD builds a new set in one go and updates an existing one
+    assert(store.zadd("multi", {{"b", 2.0}, {"a", 1.0}, {"b", 3.0}}) == 2);
+    assert(store.zscore("multi", "b").value() == 3.0);
+    assert(store.zadd("multi", {{"a", 1.0}, {"c", 0.5}}) == 1);
+    assert(store.zrange("multi", 0, -1).front().first == "c");
+
+    // ZADD conditions: XX never creates the key, CH counts updates too
+    kv::ZAddOptions xx, ch;
+    xx.xx = true;
+    ch.ch = true;
+    assert(store.zadd("cond", {{"a", 1.0}}, xx) == 0);
+    assert(!store.exists("cond"));
+    assert(store.zadd("cond", {{"a", 1.0}, {"b", 2.0}}) == 2);
+    assert(store.zadd("cond", {{"a", 5.0}, {"c", 3.0}}) == 1);
+    assert(store.zadd("cond", {{"a", 6.0}, {"b", 2.0}, {"d", 0.0}}, ch) == 2);
+
+    // HyperLogLog and Bloom filter keys
+    assert(store.pfadd("visits", {"u1", "u2", "u1"}));
+    assert(!store.pfadd("visits", {"u2"}));
+    assert(store.pfadd("visits2", {"u2", "u3"}));
+    assert(store.type("visits") == "hyperloglog");
+    assert(store.pfcount({"visits", "visits2", "missing"}) == 3);
+    store.pfmerge("all", {"visits", "visits2"});
+    assert(store.pfcount({"all"}) == 3);
+    assert(store.bfadd("seen", {"x", "y"}) == std::vector<bool>({true, true}));
+    assert(store.bfexists("seen", {"x", "z"}) == std::vector<bool>({true, false}));
+    assert(!store.bfreserve("seen", 0.01, 100));
+    assert(store.type("seen") == "bloom");
+    assert(store.restore("copy", std::string("S")) && store.pfcount({"copy"}) == 0);
+    assert(!store.restore("copy", "garbage"));
+    threw = false;
+    try {
+        store.pfadd("seen", {"x"});
+    } catch (const kv::WrongTypeError&) {
+        threw = true;
+    }
+    assert(threw);
+
+    // SET replaces a value of any type; DEL removes any type
+    store.hset("h", {{"f", "v"}});
+    store.set("h", "str");
+    assert(store.type("h") == "string");
+    store.hset("h2", {{"f", "v"}});
+    assert(store.del("h2"));
+    assert(store.type("h2") == "none");
+
+    // Expiry: expired keys read as missing and expire_due removes them
+    store.clear();
+    store.setWithTTL("t", "v", std::chrono::seconds(100));
+    assert(store.get("t").value() == "v");
+    assert(store.ttl("t") == 100);
+    store.set("plain", "v");
+    assert(store.ttl("plain") == -1);
+    assert(store.ttl("missing") == -2);
+    store.set("t", "v2");
+    assert(store.ttl("t") == -1); // SET drops the TTL
+
+    store.setWithTTL("gone", "v", std::chrono::seconds(0));
+    assert(!store.get("gone").has_value());
+    assert(!store.exists("gone"));
+    assert(store.type("gone") == "none");
+    assert(store.expire_due() == 1);
+    assert(store.expire_due() == 0);
+
+    store.setWithTTL("gone", "v", std::chrono::seconds(0));
+    assert(store.zadd("gone", "m", 1.0)); // an expired string doesn't block a new type
+
+    // Storing a sorted set over a key drops the key's TTL, even when the result is empty
+    store.setWithTTL("dest", "v", std::chrono::seconds(100));
+    store.zadd("src", "x", 1.0);
+    assert(store.zunionstore("dest", {"src"}, {1.0}, kv::Aggregate::Sum) == 1);
+    assert(store.ttl("dest") == -1);
+    store.setWithTTL("dest", "v", std::chrono::seconds(100));
+    assert(store.zinterstore("dest", {"src", "nothing"}, {1.0, 1.0}, kv::Aggregate::Sum) == 0);
+    assert(store.ttl("dest") == -2);
+    assert(store.zadd("dest", "y", 1.0));
+    assert(store.ttl("dest") == -1);
+
+    // Large values are shared, not copied, and survive being overwritten while referenced
+    std::string blob(kv::StringValue::kSharedFrom, 'b');
+    store.set("blob", blob);
+    auto first = store.get_shared("blob");
+    auto second = store.get_shared("blob");
+    assert(first && first == second && *first == blob);
+    store.set("blob", "small");
+    assert(*first == blob);
+    assert(*store.get_shared("blob") == "small");
+    assert(store.get_shared("blob") != store.get_shared("blob")); // small values are copied
+    assert(!store.get_shared("missing"));
+
+    // read_value hands out the stored bytes in place, with the buffer only for large values
+    std::string seen;
+    bool has_buffer = true;
+    assert(store.read_value("blob", [&](std::string_view value, const std::shared_ptr<const std::string>& shared) {
+        seen = value;
+        has_buffer = shared != nullptr;
+    }));
+    assert(seen == "small" && !has_buffer);
+    store.set("blob", blob);
+    assert(store.read_value("blob", [&](std::string_view value, const std::shared_ptr<const std::string>& shared) {
+        has_buffer = shared && shared->data() == value.data();
+    }));
+    assert(has_buffer);
+    assert(!store.read_value("missing", [](std::string_view, const std::shared_ptr<const std::string>&) { assert(false); }));
+
+    // Key index: ordered scans by prefix and range across shards, kept up to date by every write
+    kv::KVStore indexed(4);
+    indexed.set("tenant1:z", "v");
+    indexed.enable_key_index(); // picks up existing keys
+    indexed.set("tenant1:a", "v");
+    indexed.zadd("tenant1:m", "x", 1.0);
+    indexed.hset("tenant2:h", {{"f", "v"}});
+    indexed.set("tenant10:b", "v");
+    indexed.setWithTTL("tenant1:gone", "v", std::chrono::seconds(0));
+    kv::KeyRange tenant1;
+    tenant1.prefix = "tenant1:";
+    assert((indexed.scan_keys(tenant1, 100) == std::vector<std::string>{"tenant1:a", "tenant1:m", "tenant1:z"}));
+    assert((indexed.scan_keys(tenant1, 2) == std::vector<std::string>{"tenant1:a", "tenant1:m"}));
+    tenant1.min = "tenant1:m";
+    tenant1.min_exclusive = true;
+    assert((indexed.scan_keys(tenant1, 100) == std::vector<std::string>{"tenant1:z"}));
+    kv::KeyRange bounded;
+    bounded.max = "tenant1:m";
+    assert((indexed.scan_keys(bounded, 100) == std::vector<std::string>{"tenant10:b", "tenant1:a", "tenant1:m"}));
+    bounded.max_exclusive = true;
+    assert((indexed.scan_keys(bounded, 100) == std::vector<std::string>{"tenant10:b", "tenant1:a"}));
+    assert(indexed.zrem("tenant1:m", "x") && indexed.del("tenant1:z"));
+    assert(indexed.zpopmin("tenant1:m", 1).empty());
+    assert((indexed.scan_keys(tenant1, 100).empty()));
+    assert(indexed.expire_due() == 1);
+    assert((indexed.scan_keys(kv::KeyRange{}, 100) == std::vector<std::string>{"tenant10:b", "tenant1:a", "tenant2:h"}));
+    indexed.clear();
+    assert(indexed.scan_keys(kv::KeyRange{}, 100).empty());
+    assert(!store.key_index_enabled() && store.scan_keys(kv::KeyRange{}, 100).empty());
+
+    // Resharding: keys stay readable and writable while they move, in both directions
+    kv::KVStore resharded(4);
+    resharded.enable_key_index();
+    for (int i = 0; i < 200; i++) {
+        resharded.set("k" + std::to_string(i), std::to_string(i));
+    }
+    resharded.zadd("z", "m", 1.0);
+    resharded.setWithTTL("ttl", "v", std::chrono::seconds(100));
+    assert(!resharded.reshard(0) && !resharded.reshard(4) && !resharded.reshard(resharded.max_shards() + 1));
+    assert(resharded.reshard(8));
+    assert(!resharded.reshard(16)); // one at a time
+    assert(resharded.reshard_status().in_progress() && resharded.reshard_status().target == 8);
+    int step = 0;
+    while (resharded.reshard_step(16)) {
+        // Mid-move writes: overwrite, delete, create
+        resharded.set("k" + std::to_string(step), "new");
+        resharded.del("k" + std::to_string(100 + step));
+        resharded.set("fresh" + std::to_string(step), "v");
+        step++;
+    }
+    auto status = resharded.reshard_status();
+    assert(!status.in_progress() && status.shards == 8 && status.sources_done == 4 && status.keys_moved > 0);
+    for (int i = 0; i < 200; i++) {
+        auto value = resharded.get("k" + std::to_string(i));
+        if (i < step) {
+            assert(value == "new");
+        } else if (i >= 100 && i < 100 + step) {
+            assert(!value);
+        } else {
+            assert(value == std::to_string(i));
+        }
+    }
+    assert(resharded.zscore("z", "m") == 1.0 && resharded.ttl("ttl") > 0);
+
+    assert(resharded.reshard(2));
+    resharded.reshard_step(50);
+    assert(resharded.exists("z") && resharded.get("k150") == "150");
+    while (resharded.reshard_step()) {
+    }
+    assert(resharded.reshard_status().shards == 2);
+    assert(resharded.get("fresh0") == "v" && resharded.ttl("ttl") > 0);
+    kv::KeyRange fresh;
+    fresh.prefix = "fresh";
+    assert(resharded.scan_keys(fresh, 1000).size() == static_cast<size_t>(step));
+    assert(resharded.scan_keys(kv::KeyRange{}, 1000).size() == 200 - static_cast<size_t>(step) + 2 + step);
+
     std::cout << "All KVStore tests passed!\n";
     return 0;
 }
\ No newline at end of file
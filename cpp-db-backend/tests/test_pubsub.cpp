@@ -0,0 +1,97 @@
+#include "pubsub/pubsub.h"
+#include <cassert>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <poll.h>
+
+int main() {
+    // Test 1: Glob patterns
+    std::cout << "Test 1: Glob matching...\n";
+    assert(kv::glob_match("news.*", "news.sports"));
+    assert(!kv::glob_match("news.*", "weather"));
+    assert(kv::glob_match("h?llo", "hello"));
+    assert(kv::glob_match("h[ae]llo", "hallo"));
+    assert(!kv::glob_match("h[^e]llo", "hello"));
+    assert(kv::glob_match("h[a-c]llo", "hbllo"));
+    assert(kv::glob_match("*a*b", "xxaxxab"));
+    assert(kv::glob_match("a\\*", "a*"));
+    assert(!kv::glob_match("a\\*", "ab"));
+    assert(kv::glob_match("*", ""));
+    std::cout << "✓ Glob patterns match\n";
+
+    // Test 2: Channel and pattern delivery
+    std::cout << "\nTest 2: Publish...\n";
+    kv::PubSub pubsub;
+    auto a = std::make_shared<kv::Mailbox>();
+    auto b = std::make_shared<kv::Mailbox>();
+    pubsub.subscribe("news", a);
+    pubsub.psubscribe("n*", b);
+
+    assert(pubsub.publish("news", "hi") == 2);
+    assert(pubsub.publish("other", "hi") == 0);
+
+    pollfd fds[1] = {{a->fd(), POLLIN, 0}};
+    assert(poll(fds, 1, 0) == 1);
+
+    std::shared_ptr<const std::string> msg;
+    a->clear_notification();
+    assert(a->pop(msg));
+    assert(*msg == "*3\r\n$7\r\nmessage\r\n$4\r\nnews\r\n$2\r\nhi\r\n");
+    assert(!a->pop(msg));
+    assert(poll(fds, 1, 0) == 0);
+
+    b->clear_notification();
+    assert(b->pop(msg));
+    assert(*msg == "*4\r\n$8\r\npmessage\r\n$2\r\nn*\r\n$4\r\nnews\r\n$2\r\nhi\r\n");
+
+    pubsub.unsubscribe("news", a.get());
+    assert(pubsub.publish("news", "again") == 1);
+    std::cout << "✓ Channels and patterns deliver, unsubscribe stops delivery\n";
+
+    // Test 3: Hard output limit
+    std::cout << "\nTest 3: Output limits...\n";
+    kv::OutputLimits limits;
+    limits.hard_bytes = 100;
+    limits.soft_bytes = 100;
+    auto slow = std::make_shared<kv::Mailbox>(limits);
+    auto payload = std::make_shared<const std::string>(60, 'x');
+    assert(slow->push(payload));
+    assert(!slow->push(payload));
+    assert(slow->overflowed());
+    assert(slow->pending_bytes() == 60);
+    std::cout << "✓ Subscriber over its limit is flagged\n";
+
+    // Test 4: Many producers, one consumer
+    std::cout << "\nTest 4: Concurrent publishers...\n";
+    auto inbox = std::make_shared<kv::Mailbox>();
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; t++)
+    {
+        producers.emplace_back([inbox]() {
+            for (int i = 0; i < 10000; i++)
+            {
+                inbox->push(std::make_shared<const std::string>("m"));
+            }
+        });
+    }
+
+    size_t received = 0;
+    while (received < 40000)
+    {
+        while (inbox->pop(msg))
+        {
+            received++;
+        }
+    }
+    for (auto &t : producers)
+    {
+        t.join();
+    }
+    assert(!inbox->pop(msg));
+    assert(inbox->pending_bytes() == 0);
+    std::cout << "✓ Every message arrives exactly once\n";
+
+    std::cout << "\n✅ All pub/sub tests passed!\n";
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "net/tcp_server.h"
+#include "net/resp.h"
+#include <cassert>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+    // One client socket to the server's AF_UNIX listener, sending inline commands
+    class Connection {
+    public:
+        // Retries until the server is listening
+        explicit Connection(const std::string& path) {
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+            for (int attempt = 0;; attempt++) {
+                sock_ = socket(AF_UNIX, SOCK_STREAM, 0);
+                if (connect(sock_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+                    break;
+                }
+                close(sock_);
+                assert(attempt < 500);
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+
+        ~Connection() { close(sock_); }
+
+        kv::Reply command(const std::string& line) {
+            std::string out = line + "\r\n";
+            ssize_t sent = send(sock_, out.data(), out.size(), MSG_NOSIGNAL);
+            assert(sent == static_cast<ssize_t>(out.size()));
+
+            kv::Reply reply;
+            char chunk[4096];
+            while (true) {
+                if (size_t used = kv::parse_reply(buffer_, reply)) {
+                    buffer_.erase(0, used);
+                    return reply;
+                }
+                ssize_t n = recv(sock_, chunk, sizeof(chunk), 0);
+                assert(n > 0); // the server is still up
+                buffer_.append(chunk, n);
+            }
+        }
+
+    private:
+        int sock_;
+        std::string buffer_;
+    };
+}
+
+int main() {
+    std::string path = "/tmp/test_server_" + std::to_string(getpid()) + ".sock";
+    kv::TCPServer server(0, 4);
+    kv::ListenOptions options;
+    options.unix_path = path;
+    server.set_listen_options(options);
+    std::thread runner([&server] { server.start(); });
+
+    {
+        Connection client(path);
+
+        // Test 1: A bad numkeys is an error, not a crash
+        std::cout << "Test 1: ZUNIONSTORE/ZINTERSTORE numkeys...\n";
+        assert(client.command("ZADD a 1 x").integer == 1);
+        for (std::string command : {"ZUNIONSTORE", "ZINTERSTORE"}) {
+            for (std::string numkeys : {"-1", "-2", "-3", "0", "2", "x", "99999999999999999999"}) {
+                assert(client.command(command + " d " + numkeys + " a").is_error());
+            }
+            assert(client.command(command + " d 1 a").integer == 1);
+        }
+        std::cout << "✓ Negative, zero and too large counts are refused\n";
+
+        // Test 2: The same inside MULTI
+        std::cout << "\nTest 2: numkeys inside MULTI...\n";
+        assert(client.command("MULTI").str == "OK");
+        client.command("ZUNIONSTORE d -1 a");
+        client.command("ZINTERSTORE d -3 a WEIGHTS 1");
+        kv::Reply exec = client.command("EXEC");
+        assert(exec.type == kv::Reply::Type::Array || exec.is_error());
+        assert(client.command("SET k v").str == "OK" && client.command("GET k").str == "v");
+        std::cout << "✓ EXEC completes and the server keeps serving\n";
+
+        // Test 3: GET encodes small values in place and sends large ones from their buffer
+        std::cout << "\nTest 3: GET...\n";
+        std::string large(kv::StringValue::kSharedFrom + 1, 'L');
+        assert(client.command("SET small s").str == "OK" && client.command("SET large " + large).str == "OK");
+        assert(client.command("GET small").str == "s");
+        assert(client.command("GET large").str == large);
+        assert(client.command("GET missing").type == kv::Reply::Type::Null);
+        std::cout << "✓ Small, large and missing values\n";
+    }
+
+    server.stop();
+    runner.join();
+
+    std::cout << "\nAll server tests passed!\n";
+    return 0;
+}
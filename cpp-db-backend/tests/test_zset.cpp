@@ -1,6 +1,10 @@
 #include "kv/zset.h"
+#include "kv/zset_algebra.h"
+#include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <map>
+#include <random>
 
 int main() {
     kv::ZSet zset;
@@ -87,6 +91,193 @@ int main() {
     assert(!empty_zset.score("anything").has_value());
     std::cout << "✓ Empty zset handled correctly\n";
 
+    // Test 11: Pop from both ends
+    std::cout << "\nTest 11: Pop min/max...\n";
+    kv::ZSet queue;
+    queue.add("a", 1.0);
+    queue.add("b", 2.0);
+    queue.add("c", 3.0);
+    queue.add("d", 4.0);
+    auto low = queue.pop_min(2);
+    assert(low.size() == 2 && low[0].first == "a" && low[1].first == "b");
+    auto high = queue.pop_max(1);
+    assert(high.size() == 1 && high[0].first == "d" && high[0].second == 4.0);
+    queue.add("e", 0.5);
+    queue.add("f", 9.0);
+    assert(queue.pop_max(1)[0].first == "f"); // tail moves forward on insert
+    assert(queue.pop_max(1)[0].first == "c"); // and back on pop
+    assert(queue.pop_max(5).size() == 1);
+    assert(queue.size() == 0);
+    assert(queue.pop_min(1).empty() && queue.pop_max(1).empty());
+    queue.add("g", 1.0);
+    assert(queue.pop_max(1)[0].first == "g");
+    std::cout << "✓ Pops come from the right end and keep the tail current\n";
+
+    // Test 12: Churn with a small max level keeps every level consistent
+    std::cout << "\nTest 12: Churn...\n";
+    kv::ZSet churn(2, 0); // skip list from the start
+    for (int round = 0; round < 50; round++) {
+        for (int i = 0; i < 20; i++) {
+            churn.add("m" + std::to_string(i), (i * 7 + round) % 13);
+        }
+        for (int i = 0; i < 20; i += 2) {
+            churn.remove("m" + std::to_string(i));
+        }
+        auto all = churn.all();
+        assert(all.size() == churn.size());
+        for (size_t i = 1; i < all.size(); i++) {
+            assert(all[i - 1].second <= all[i].second);
+        }
+        churn.pop_min(3);
+        churn.pop_max(3);
+    }
+    std::cout << "✓ Skip list stays ordered through inserts, removes and pops\n";
+
+    // Test 13: Union and intersection with weights and aggregates
+    std::cout << "\nTest 13: Union/intersection...\n";
+    kv::ZSet s1, s2;
+    s1.add("a", 1.0);
+    s1.add("b", 2.0);
+    s2.add("b", 3.0);
+    s2.add("c", 4.0);
+    auto u = kv::zunion({&s1, &s2}, {1.0, 2.0}, kv::Aggregate::Sum);
+    assert(u.size() == 3);
+    assert(u.score("a").value() == 1.0 && u.score("b").value() == 8.0 && u.score("c").value() == 8.0);
+    assert(u.all()[1].first == "b" && u.all()[2].first == "c"); // ties ordered by member
+    auto inter = kv::zinter({&s1, &s2}, {1.0, 1.0}, kv::Aggregate::Max);
+    assert(inter.size() == 1 && inter.score("b").value() == 3.0);
+    auto missing = kv::zinter({&s1, nullptr}, {1.0, 1.0}, kv::Aggregate::Sum);
+    assert(missing.size() == 0);
+    auto with_missing = kv::zunion({&s1, nullptr}, {1.0, 1.0}, kv::Aggregate::Min);
+    assert(with_missing.size() == 2);
+    std::cout << "✓ Weights and SUM/MIN/MAX combine scores\n";
+
+    // Test 14: Partitioned union matches the single-threaded one
+    std::cout << "\nTest 14: Parallel union...\n";
+    kv::ZSet big1, big2;
+    for (int i = 0; i < 5000; i++) {
+        big1.add("m" + std::to_string(i), i % 97);
+        big2.add("m" + std::to_string(i * 2), i % 89);
+    }
+    auto serial = kv::zunion({&big1, &big2}, {1.0, 1.0}, kv::Aggregate::Sum, 1);
+    auto parallel = kv::zunion({&big1, &big2}, {1.0, 1.0}, kv::Aggregate::Sum, 4);
+    assert(serial.size() == parallel.size());
+    assert(serial.all() == parallel.all());
+    // Uneven slices, weights, a packed input and a missing key, with every aggregate
+    std::vector<const kv::ZSet*> inputs{&big1, nullptr, &s1, &big2};
+    std::vector<double> weights{0.5, 1.0, -2.0, 3.0};
+    for (auto aggregate : {kv::Aggregate::Sum, kv::Aggregate::Min, kv::Aggregate::Max}) {
+        auto one = kv::zunion(inputs, weights, aggregate, 1);
+        for (size_t partitions : {2, 3, 7}) {
+            assert(kv::zunion(inputs, weights, aggregate, partitions).all() == one.all());
+        }
+    }
+    parallel.add("m0", -1.0); // the bulk-loaded skip list takes normal updates
+    assert(parallel.rank("m0").value() == 0);
+    assert(parallel.pop_max(1)[0].second == serial.all().back().second);
+    std::cout << "✓ Partitions merge into the same ordered set\n";
+
+    // Test 15: Bulk build from unsorted pairs
+    std::cout << "\nTest 15: Bulk build...\n";
+    kv::ZSet built;
+    std::vector<std::pair<std::string, double>> pairs;
+    for (int i = 0; i < 3000; i++) {
+        pairs.emplace_back("k" + std::to_string((i * 7919) % 2000), (i * 31) % 113);
+    }
+    pairs.emplace_back("k5", -10.0); // a later pair for the same member wins
+    kv::ZSet expected;
+    for (const auto& [member, score] : pairs) {
+        expected.add(member, score);
+    }
+    built.build(std::move(pairs));
+    assert(built.size() == 2000);
+    assert(built.all() == expected.all());
+    assert(built.rank("k5").value() == 0);
+    assert(built.remove("k5") && built.add("k5", 1000.0));
+    assert(built.rank("k5").value() == 1999);
+    assert(built.pop_min(1)[0].first == expected.all()[1].first);
+    std::cout << "✓ Build matches incremental inserts and takes later updates\n";
+
+    // Test 16: Conditional adds and score updates
+    std::cout << "\nTest 16: NX/XX/GT/LT and score updates...\n";
+    using Result = kv::ZSet::ZAddResult;
+    kv::ZSet cond;
+    kv::ZAddOptions nx, xx, gt, lt;
+    nx.nx = true;
+    xx.xx = true;
+    gt.gt = true;
+    lt.lt = true;
+    assert(cond.add("a", 1.0, xx) == Result::Unchanged && cond.size() == 0);
+    assert(cond.add("a", 1.0, nx) == Result::Added);
+    assert(cond.add("a", 2.0, nx) == Result::Unchanged);
+    assert(cond.add("a", 2.0, xx) == Result::Updated);
+    assert(cond.add("a", 1.0, gt) == Result::Unchanged && cond.score("a").value() == 2.0);
+    assert(cond.add("a", 3.0, gt) == Result::Updated);
+    assert(cond.add("a", 4.0, lt) == Result::Unchanged);
+    assert(cond.add("b", 9.0, lt) == Result::Added); // GT/LT still add new members
+    assert(cond.add("b", 9.0, kv::ZAddOptions{}) == Result::Unchanged);
+
+    // Small moves are made in place, large ones relink; the order must hold either way
+    kv::ZSet moving;
+    std::mt19937 rng(42);
+    std::map<std::string, double> scores;
+    for (int i = 0; i < 20000; i++) {
+        std::string member = "m" + std::to_string(rng() % 500);
+        double score = (rng() % 2) ? scores[member] + 0.001 * (rng() % 3) : rng() % 1000;
+        moving.add(member, score);
+        scores[member] = score;
+    }
+    std::vector<std::pair<std::string, double>> by_score(scores.begin(), scores.end());
+    std::sort(by_score.begin(), by_score.end(), [](const auto& x, const auto& y) {
+        return x.second < y.second || (x.second == y.second && x.first < y.first);
+    });
+    assert(moving.all() == by_score);
+    assert(moving.pop_max(1)[0] == by_score.back());
+    std::cout << "✓ Conditions respected and order kept across updates\n";
+
+    // Test 17: Packed sets behave like skip lists and convert past the threshold
+    std::cout << "\nTest 17: Packed encoding...\n";
+    kv::ZSet packed(16, 32), list(16, 0);
+    assert(packed.is_packed() && !list.is_packed());
+    kv::ZAddOptions opts[4];
+    opts[1].nx = true;
+    opts[2].xx = true;
+    opts[3].gt = true;
+    for (int i = 0; i < 3000; i++) {
+        std::string member = "p" + std::to_string(rng() % 40);
+        double score = rng() % 10;
+        switch (rng() % 4) {
+        case 0:
+            assert(packed.remove(member) == list.remove(member));
+            break;
+        case 1:
+            assert(packed.pop_min(1) == list.pop_min(1));
+            break;
+        default: {
+            const auto& o = opts[rng() % 4];
+            assert(packed.add(member, score, o) == list.add(member, score, o));
+        }
+        }
+        assert(packed.size() == list.size());
+        assert(packed.rank(member) == list.rank(member) && packed.score(member) == list.score(member));
+        if (packed.size() > 32) {
+            break;
+        }
+    }
+    assert(packed.all() == list.all());
+    assert(packed.range(1, -2) == list.range(1, -2) && packed.range(-100, 100) == list.range(-100, 100));
+    assert(packed.pop_max(3) == list.pop_max(3));
+    while (packed.is_packed()) {
+        packed.add("fill" + std::to_string(packed.size()), 1.0);
+        list.add("fill" + std::to_string(list.size()), 1.0);
+    }
+    assert(packed.size() == 33 && packed.all() == list.all());
+    kv::ZSet tiny;
+    tiny.build({{"b", 2.0}, {"a", 1.0}, {"b", 0.5}});
+    assert(tiny.is_packed() && tiny.all().front().first == "b");
+    assert(sizeof(kv::ZSet) <= 64);
+    std::cout << "✓ Same results in both encodings, " << sizeof(kv::ZSet) << " bytes per packed set\n";
+
     std::cout << "\n✅ All ZSet tests passed!\n";
     return 0;
 }
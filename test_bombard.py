@@ -4,6 +4,7 @@ Load test script for TCP database server.
 Spawns multiple clients that send pipelined commands concurrently.
 """
 
+import argparse
 import socket
 import threading
 import time
@@ -54,6 +55,16 @@ def client_worker(client_id):
         print(f"Client {client_id} error: {e}")
 
 def main():
+    global SERVER_PORT, NUM_CLIENTS, COMMANDS_PER_CLIENT
+
+    # e.g. compare backends: run tcp_server with --backend threads, then --backend uring
+    parser = argparse.ArgumentParser(description="Pipelined load test for tcp_server")
+    parser.add_argument("--port", type=int, default=SERVER_PORT)
+    parser.add_argument("--clients", type=int, default=NUM_CLIENTS)
+    parser.add_argument("--commands", type=int, default=COMMANDS_PER_CLIENT)
+    args = parser.parse_args()
+    SERVER_PORT, NUM_CLIENTS, COMMANDS_PER_CLIENT = args.port, args.clients, args.commands
+
     print(f"Starting load test: {NUM_CLIENTS} clients × {COMMANDS_PER_CLIENT} commands each")
     print(f"Total commands: {NUM_CLIENTS * (COMMANDS_PER_CLIENT + 10)}")
     